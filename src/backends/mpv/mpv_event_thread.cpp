@@ -0,0 +1,192 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "mpv_event_thread.h"
+
+#include <mpv/client.h>
+
+namespace dmr {
+
+static void logMessage(const mpv_event_log_message *ev)
+{
+    switch (ev->log_level) {
+        case MPV_LOG_LEVEL_WARN: 
+            qWarning() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+            break;
+
+        case MPV_LOG_LEVEL_ERROR: 
+        case MPV_LOG_LEVEL_FATAL: 
+            qCritical() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+            break;
+
+        case MPV_LOG_LEVEL_INFO: 
+            qInfo() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+            break;
+
+        default:
+            qDebug() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+            break;
+    }
+}
+
+static QByteArray propertyString(mpv_handle *h, const char *name)
+{
+    char *s = mpv_get_property_string(h, name);
+    QByteArray ret(s ? s : "");
+    mpv_free(s);
+    return ret;
+}
+
+MpvEventThread::MpvEventThread(mpv_handle *h, const std::function<void()>& notify)
+    :QThread(), _handle(h), _notify(notify)
+{
+    _clock.start();
+}
+
+MpvEventThread::~MpvEventThread()
+{
+    stop();
+}
+
+void MpvEventThread::stop()
+{
+    if (!isRunning()) return;
+    _quit.store(true);
+    mpv_wakeup(_handle);
+    wait();
+}
+
+bool MpvEventThread::push(const MpvEventRecord& rec)
+{
+    auto t = _tail.load(std::memory_order_relaxed);
+    if (t - _head.load(std::memory_order_acquire) == Capacity) return false;
+
+    _ring[t % Capacity] = rec;
+    _tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+bool MpvEventThread::pop(MpvEventRecord& rec)
+{
+    auto h = _head.load(std::memory_order_relaxed);
+    if (h == _tail.load(std::memory_order_acquire)) return false;
+
+    rec = _ring[h % Capacity];
+    _head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+// false if the gui has nothing to do with it
+bool MpvEventThread::decode(mpv_event *ev, MpvEventRecord& rec)
+{
+    rec = MpvEventRecord {};
+    rec.id = ev->event_id;
+
+    switch (ev->event_id) {
+        case MPV_EVENT_LOG_MESSAGE:
+            logMessage((mpv_event_log_message*)ev->data);
+            return false;
+
+        case MPV_EVENT_PROPERTY_CHANGE: {
+            auto *p = (mpv_event_property*)ev->data;
+            rec.prop = (MpvProp)ev->reply_userdata;
+            // MPV_FORMAT_NONE when unavailable, e.g time-pos while idle
+            rec.valid = true;
+            switch (p->format) {
+                case MPV_FORMAT_DOUBLE: rec.value.d = *(double*)p->data; break;
+                case MPV_FORMAT_INT64: rec.value.i = *(int64_t*)p->data; break;
+                case MPV_FORMAT_FLAG: rec.value.b = *(int*)p->data != 0; break;
+                default: rec.valid = false; break;
+            }
+
+            if (rec.prop != MpvProp::TimePos && rec.prop != MpvProp::FrameDrops
+                    && rec.prop != MpvProp::DecoderFrameDrops)
+                qDebug() << p->name;
+            return true;
+        }
+
+        case MPV_EVENT_COMMAND_REPLY:
+            rec.error = ev->error;
+            rec.tag = ev->reply_userdata;
+            if (ev->error < 0) {
+                qDebug() << "command error" << mpv_error_string(ev->error);
+            }
+            return true;
+
+        case MPV_EVENT_TRACKS_CHANGED:
+            qDebug() << mpv_event_name(ev->event_id);
+            if (_readTracks) _readTracks();
+            return true;
+
+        case MPV_EVENT_FILE_LOADED:
+            qDebug() << mpv_event_name(ev->event_id);
+            qDebug() << "hwdec-interop" << propertyString(_handle, "hwdec-interop");
+            qDebug() << "rotate metadata: dec" << propertyString(_handle, "video-dec-params/rotate")
+                << "out" << propertyString(_handle, "video-params/rotate");
+            return true;
+
+        case MPV_EVENT_END_FILE:
+            rec.error = ((mpv_event_end_file*)ev->data)->reason;
+            qDebug() << mpv_event_name(ev->event_id) << "reason " << rec.error;
+            return true;
+
+        case MPV_EVENT_IDLE:
+            qDebug() << mpv_event_name(ev->event_id);
+            return true;
+
+        case MPV_EVENT_PLAYBACK_RESTART:
+        case MPV_EVENT_VIDEO_RECONFIG:
+            return true;
+
+        default:
+            qDebug() << mpv_event_name(ev->event_id);
+            return false;
+    }
+}
+
+void MpvEventThread::run()
+{
+    MpvEventRecord rec;
+    while (!_quit.load()) {
+        auto *ev = mpv_wait_event(_handle, -1);
+        if (ev->event_id == MPV_EVENT_SHUTDOWN) break;
+        if (ev->event_id == MPV_EVENT_NONE || !decode(ev, rec)) continue;
+
+        rec.queued = now();
+        // the gui is far behind, wait for room rather than lose a state change
+        while (!push(rec)) {
+            if (_quit.load()) return;
+            QThread::usleep(200);
+        }
+
+        if (!_notified.exchange(true)) _notify();
+    }
+}
+
+}
@@ -0,0 +1,128 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_MPV_EVENT_THREAD_H
+#define _DMR_MPV_EVENT_THREAD_H 
+
+#include <QtCore>
+#include <atomic>
+#include <functional>
+
+struct mpv_handle;
+struct mpv_event;
+
+namespace dmr {
+
+// properties observed by MpvProxy, passed as reply_userdata of
+// mpv_observe_property so events are told apart without their names
+enum class MpvProp: quint8 {
+    Unknown,
+    TimePos,
+    Duration,
+    Pause,
+    IdleActive,
+    Mute,
+    Volume,
+    Sid,
+    Aid,
+    DWidth,
+    DHeight,
+    Rotate,
+    FrameDrops,
+    DecoderFrameDrops,
+    CoreIdle,
+};
+
+// what the gui thread gets to know of an mpv event: fixed size, and
+// nothing in it to be freed
+struct MpvEventRecord {
+    int id;          // mpv_event_id
+    MpvProp prop;    // MPV_EVENT_PROPERTY_CHANGE
+    bool valid;      // property is available, value is set
+    int error;       // command reply error, end file reason
+    quint64 tag;     // reply_userdata of a command reply
+    union {
+        double d;
+        qint64 i;
+        bool b;
+    } value;
+    qint64 queued;   // nsecs on the clock of now()
+};
+
+/* Waits for mpv events on a thread of its own and decodes them into
+ * MpvEventRecords, which are handed to the gui thread through a single
+ * producer single consumer ring. Log messages and events the gui does
+ * not care about are dealt with here.
+ *
+ * notify is called on the event thread when records become available.
+ * the consumer calls rearm() and then pop()s until the ring is empty.
+ */
+class MpvEventThread: public QThread {
+public:
+    MpvEventThread(mpv_handle *h, const std::function<void()>& notify);
+    ~MpvEventThread();
+
+    // called on the event thread for MPV_EVENT_TRACKS_CHANGED, before its
+    // record is queued, so the track list is read off the gui thread
+    void setTracksReader(const std::function<void()>& f) { _readTracks = f; }
+
+    // wakes the thread up and waits for it to finish
+    void stop();
+
+    // consumer side
+    void rearm() { _notified.store(false); }
+    bool pop(MpvEventRecord& rec);
+    int depth() const { return _tail.load() - _head.load(); }
+    qint64 now() const { return _clock.nsecsElapsed(); }
+
+protected:
+    void run() override;
+
+private:
+    enum { Capacity = 1024 };
+
+    mpv_handle *_handle {nullptr};
+    std::function<void()> _notify;
+    std::function<void()> _readTracks;
+    std::atomic<bool> _quit {false};
+    std::atomic<bool> _notified {false};
+
+    // free running counters, slots are taken modulo Capacity
+    std::atomic<unsigned> _head {0}; // next to pop
+    std::atomic<unsigned> _tail {0}; // next to push
+    MpvEventRecord _ring[Capacity];
+    QElapsedTimer _clock;
+
+    bool decode(mpv_event *ev, MpvEventRecord& rec);
+    bool push(const MpvEventRecord& rec);
+};
+
+}
+
+#endif /* ifndef _DMR_MPV_EVENT_THREAD_H */
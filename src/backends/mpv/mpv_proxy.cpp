@@ -30,10 +30,12 @@
 #include "config.h"
 
 #include "mpv_proxy.h"
+#include "mpv_event_thread.h"
 #include "mpv_glwidget.h"
 #include "compositing_manager.h"
 #include "utility.h"
 #include "player_engine.h"
+#include "frame_decoder.h"
 #ifndef _LIBDMR_
 #include "dmr_settings.h"
 #include "movie_configuration.h"
@@ -41,7 +43,9 @@
 #include <mpv/client.h>
 
 #include <random>
+#include <string.h>
 #include <QtWidgets>
+#include <QtConcurrent>
 #include <QtGlobal>
 
 #include <xcb/xproto.h>
@@ -51,10 +55,21 @@
 namespace dmr {
 using namespace mpv::qt;
 
+// kinds of async requests, a newer one supersedes what is in flight of
+// the same kind
 enum AsyncReplyTag {
     SEEK,
     CHANNEL,
-    SPEED
+    SPEED,
+    STOP,
+    NEXT,
+    LOAD,
+    PRELOAD,
+    PLAYLIST,
+    STEP,
+    VOLUME,
+    SUBTITLE,
+    PROPERTY
 };
 
 
@@ -72,12 +87,6 @@ static inline int set_property_async(mpv_handle *ctx, const QString &name,
     return mpv_set_property_async(ctx, tag, name.toUtf8().data(), MPV_FORMAT_NODE, node.node());
 }
 
-static void mpv_callback(void *d)
-{
-    MpvProxy *mpv = static_cast<MpvProxy*>(d);
-    QMetaObject::invokeMethod(mpv, "has_mpv_events", Qt::QueuedConnection);
-}
-
 MpvProxy::MpvProxy(QWidget *parent)
     :Backend(parent)
 {
@@ -87,7 +96,25 @@ MpvProxy::MpvProxy(QWidget *parent)
         qDebug() << "proxy hook winId " << this->winId();
     }
 
+    _elapsedTimer.setSingleShot(true);
+    connect(&_elapsedTimer, &QTimer::timeout, this, &MpvProxy::flushElapsed);
+
+    // mpv may never report the end, don't hold the next file back forever
+    _switchTimeout.setSingleShot(true);
+    _switchTimeout.setInterval(3000);
+    connect(&_switchTimeout, &QTimer::timeout, this, [=]() {
+        if (!_switching) return;
+        qWarning() << "no end of playback reported, switch anyway";
+        finishSwitch();
+    });
+
     _handle = Handle::FromRawHandle(mpv_init());
+    // called on the event thread, records are handled on ours
+    _events = new MpvEventThread(_handle, [this]() {
+        QMetaObject::invokeMethod(this, "has_mpv_events", Qt::QueuedConnection);
+    });
+    _events->setTracksReader([this]() { updatePlayingMovieInfo(); });
+    _events->start();
     if (CompositingManager::get().composited()) {
         _gl_widget = new MpvGLWidget(this, _handle);
         connect(this, &MpvProxy::stateChanged, [=]() {
@@ -108,6 +135,10 @@ MpvProxy::MpvProxy(QWidget *parent)
 
 MpvProxy::~MpvProxy()
 {
+    // before the handle goes away
+    _events->stop();
+    delete _events;
+
     disconnect(this, &MpvProxy::has_mpv_events, this, &MpvProxy::handle_mpv_events);
     _connectStateChange = false;
     disconnect(window()->windowHandle(), &QWindow::windowStateChanged, 0, 0);
@@ -115,6 +146,8 @@ MpvProxy::~MpvProxy()
         disconnect(this, &MpvProxy::stateChanged, 0, 0);
         delete _gl_widget;
     }
+
+    if (_burstCancel) _burstCancel->store(1);
 }
 
 mpv_handle* MpvProxy::mpv_init()
@@ -234,22 +267,30 @@ mpv_handle* MpvProxy::mpv_init()
     }
 #endif
     
-    //only to get notification without data
-    mpv_observe_property(h, 0, "time-pos", MPV_FORMAT_NONE); //playback-time ?
-    mpv_observe_property(h, 0, "pause", MPV_FORMAT_NONE);
-    mpv_observe_property(h, 0, "mute", MPV_FORMAT_NONE);
-    mpv_observe_property(h, 0, "volume", MPV_FORMAT_NONE); //ao-volume ?
-    mpv_observe_property(h, 0, "sid", MPV_FORMAT_NONE);
-    mpv_observe_property(h, 0, "aid", MPV_FORMAT_NODE);
-    mpv_observe_property(h, 0, "dwidth", MPV_FORMAT_NODE);
-    mpv_observe_property(h, 0, "dheight", MPV_FORMAT_NODE);
+    // values come with the notifications and are kept in _mirror, so
+    // getters don't have to ask mpv. reply_userdata tells them apart
+    mpv_observe_property(h, (uint64_t)MpvProp::TimePos, "time-pos", MPV_FORMAT_DOUBLE); //playback-time ?
+    mpv_observe_property(h, (uint64_t)MpvProp::Duration, "duration", MPV_FORMAT_DOUBLE);
+    mpv_observe_property(h, (uint64_t)MpvProp::Pause, "pause", MPV_FORMAT_FLAG);
+    mpv_observe_property(h, (uint64_t)MpvProp::IdleActive, "idle-active", MPV_FORMAT_FLAG);
+    mpv_observe_property(h, (uint64_t)MpvProp::Mute, "mute", MPV_FORMAT_FLAG);
+    mpv_observe_property(h, (uint64_t)MpvProp::Volume, "volume", MPV_FORMAT_DOUBLE); //ao-volume ?
+    mpv_observe_property(h, (uint64_t)MpvProp::Sid, "sid", MPV_FORMAT_INT64);
+    mpv_observe_property(h, (uint64_t)MpvProp::Aid, "aid", MPV_FORMAT_INT64);
+    mpv_observe_property(h, (uint64_t)MpvProp::DWidth, "dwidth", MPV_FORMAT_INT64);
+    mpv_observe_property(h, (uint64_t)MpvProp::DHeight, "dheight", MPV_FORMAT_INT64);
+    mpv_observe_property(h, (uint64_t)MpvProp::Rotate, "video-out-params/rotate", MPV_FORMAT_INT64);
+    mpv_observe_property(h, (uint64_t)MpvProp::FrameDrops, "frame-drop-count", MPV_FORMAT_INT64);
+    mpv_observe_property(h, (uint64_t)MpvProp::DecoderFrameDrops, "decoder-frame-drop-count", MPV_FORMAT_INT64);
+
+    // the next file is opened while the current one still plays, see preload()
+    set_property(h, "prefetch-playlist", "yes");
 
     // because of vpu, we need to implement playlist w/o mpv 
     //mpv_observe_property(h, 0, "playlist-pos", MPV_FORMAT_NONE);
     //mpv_observe_property(h, 0, "playlist-count", MPV_FORMAT_NONE);
-    mpv_observe_property(h, 0, "core-idle", MPV_FORMAT_NODE);
+    mpv_observe_property(h, (uint64_t)MpvProp::CoreIdle, "core-idle", MPV_FORMAT_FLAG);
 
-    mpv_set_wakeup_callback(h, mpv_callback, this);
     connect(this, &MpvProxy::has_mpv_events, this, &MpvProxy::handle_mpv_events,
             Qt::DirectConnection);
     if (mpv_initialize(h) < 0) {
@@ -282,212 +323,479 @@ void MpvProxy::setState(PlayState s)
 }
 
 
-void MpvProxy::pollingEndOfPlayback()
+void MpvProxy::endPlayback()
 {
-    if (_state != Backend::Stopped) {
-        _polling = true;
-        blockSignals(true);
-        stop();
-        auto idle = get_property(_handle, "idle-active").toBool();
-        if (idle) {
-            blockSignals(false);
-            setState(Backend::Stopped);
-            _polling = false;
-            return;
-        }
+    if (_state == Backend::Stopped || _switching) return;
 
-        while (_state != Backend::Stopped) {
-            mpv_event* ev = mpv_wait_event(_handle, 0.005);
-            if (ev->event_id == MPV_EVENT_NONE) 
-                continue;
+    // asked for real, the mirror may not have caught up with a fresh load.
+    // neither has mpv while the load is still in flight
+    if (!_latestRequests.contains(AsyncReplyTag::LOAD) && query("idle-active").toBool()) {
+        setState(Backend::Stopped);
+        return;
+    }
 
-            if (ev->event_id == MPV_EVENT_END_FILE) {
-                qDebug() << "end of playback";
-                blockSignals(false);
-                setState(Backend::Stopped);
-                break;
-            }
-        }
+    // the end arrives as MPV_EVENT_END_FILE, see handle_mpv_events
+    // stop clears mpv's playlist, the preloaded entry is gone as well
+    _preloaded.clear();
+    cancelRequest(AsyncReplyTag::PRELOAD);
+    _advancing = false;
+    _switching = true;
+    _switchTimer.start();
+    _switchTimeout.start();
+    if (!commandAsync(QList<QVariant> {"stop"}, AsyncReplyTag::STOP)) {
+        finishSwitch();
+    }
+}
 
-        _polling = false;
+void MpvProxy::finishSwitch()
+{
+    _switching = false;
+    _switchTimeout.stop();
+    qDebug() << "end of playback for switch";
+    if (!_pendingLoad.isEmpty()) {
+        auto args = _pendingLoad;
+        _pendingLoad.clear();
+        loadFile(args);
+    } else {
+        _switchTimer.invalidate();
+        setState(PlayState::Stopped);
     }
 }
 
-void MpvProxy::pollingStartOfPlayback()
+const PlayingMovieInfo& MpvProxy::playingMovieInfo()
 {
-    if (_state == Backend::PlayState::Stopped) {
-        _polling = true;
+    return _pmf;
+}
 
-        while (_state == Backend::Stopped) {
-            mpv_event* ev = mpv_wait_event(_handle, 0.005);
-            if (ev->event_id == MPV_EVENT_NONE) 
-                continue;
+void MpvProxy::handle_mpv_events()
+{
+    // records pushed from here on notify again
+    _events->rearm();
+    _depthMax = qMax(_depthMax, _events->depth());
+
+    MpvEventRecord rec;
+    while (_events->pop(rec)) {
+        auto latency = _events->now() - rec.queued;
+        _eventCount++;
+        _latencySum += latency;
+        _latencyMax = qMax(_latencyMax, latency);
+
+        processEvent(rec);
+    }
 
-            if (ev->event_id == MPV_EVENT_FILE_LOADED) {
-                qDebug() << "start of playback";
-                setState(Backend::Playing);
-                break;
+    reportEventStats();
+}
+
+void MpvProxy::reportEventStats()
+{
+    if (!_eventClock.isValid()) {
+        _eventClock.start();
+        return;
+    }
+
+    if (_eventClock.elapsed() < 10000 || _eventCount == 0) return;
+
+    qDebug() << "mpv events handled:" << _eventCount
+        << "latency avg" << _latencySum / _eventCount / 1000 << "us"
+        << "max" << _latencyMax / 1000 << "us"
+        << "queue depth max" << _depthMax;
+    _eventCount = 0;
+    _latencySum = 0;
+    _latencyMax = 0;
+    _depthMax = 0;
+    _eventClock.restart();
+}
+
+// every request gets an id of its own as reply_userdata
+quint64 MpvProxy::trackRequest(int kind)
+{
+    cancelRequest(kind);
+
+    auto id = ++_lastRequestId;
+    auto& r = _requests[id];
+    r.kind = kind;
+    r.issued.start();
+    _latestRequests[kind] = id;
+    return id;
+}
+
+// 0 if mpv didn't take it
+quint64 MpvProxy::commandAsync(const QList<QVariant>& args, int kind)
+{
+    auto id = trackRequest(kind);
+    if (!command_async(_handle, args, id)) {
+        qWarning() << "failed to issue" << args;
+        _requests.remove(id);
+        _latestRequests.remove(kind);
+        return 0;
+    }
+    return id;
+}
+
+quint64 MpvProxy::setPropertyAsync(const char *name, const QVariant& v, int kind)
+{
+    auto id = trackRequest(kind);
+    if (set_property_async(_handle, name, v, id) < 0) {
+        qWarning() << "failed to set" << name << v;
+        _requests.remove(id);
+        _latestRequests.remove(kind);
+        return 0;
+    }
+    return id;
+}
+
+// the reply of what is in flight of kind will be ignored. a file still
+// being opened is given up by mpv too
+void MpvProxy::cancelRequest(int kind)
+{
+    auto p = _latestRequests.find(kind);
+    if (p == _latestRequests.end()) return;
+
+#if MPV_CLIENT_API_VERSION >= MPV_MAKE_VERSION(1, 104)
+    if (kind == AsyncReplyTag::LOAD) {
+        mpv_abort_async_command(_handle, p.value());
+    }
+#endif
+    _latestRequests.erase(p);
+}
+
+void MpvProxy::processReply(int kind, int error)
+{
+    switch (kind) {
+        case AsyncReplyTag::SEEK:
+            this->_pendingSeek = false;
+            // the player stays where it is, shoot there
+            if (error < 0 && _burstSeeking) {
+                shootBurstFrame();
             }
-        }
+            break;
+
+        case AsyncReplyTag::STOP:
+            // nothing was playing after all, no end will be reported
+            if (error < 0 && _switching) {
+                finishSwitch();
+            }
+            break;
+
+        case AsyncReplyTag::NEXT:
+            // the preloaded entry was not there anymore, load it the usual way
+            if (error < 0 && _advancing) {
+                _advancing = false;
+                auto args = _pendingLoad;
+                _pendingLoad.clear();
+                loadFile(args);
+            }
+            break;
 
-        _polling = false;
+        case AsyncReplyTag::PRELOAD:
+            if (error < 0) {
+                _preloaded.clear();
+            }
+            break;
+
+        case AsyncReplyTag::LOAD:
+            if (error < 0) {
+                qWarning() << "loadfile failed" << _file;
+            }
+            break;
+
+        default:
+            break;
     }
 }
 
-const PlayingMovieInfo& MpvProxy::playingMovieInfo()
+// loadArgs() passes local files by path
+static QUrl urlOfPath(const QString& path)
 {
-    return _pmf;
+    return path.startsWith('/') ? QUrl::fromLocalFile(path) : QUrl(path);
 }
 
-void MpvProxy::handle_mpv_events()
+void MpvProxy::processEvent(const MpvEventRecord& rec)
 {
-    while (1) {
-        mpv_event* ev = mpv_wait_event(_handle, 0.0005);
-        if (ev->event_id == MPV_EVENT_NONE) 
+    switch (rec.id) {
+        case MPV_EVENT_PROPERTY_CHANGE:
+            processPropertyChange(rec);
             break;
 
-        switch (ev->event_id) {
-            case MPV_EVENT_LOG_MESSAGE:
-                processLogMessage((mpv_event_log_message*)ev->data);
-                break;
+        case MPV_EVENT_COMMAND_REPLY: {
+            auto p = _requests.find(rec.tag);
+            if (p == _requests.end()) break;
 
-            case MPV_EVENT_PROPERTY_CHANGE:
-                processPropertyChange((mpv_event_property*)ev->data);
-                break;
+            auto kind = p->kind;
+            auto took = p->issued.elapsed();
+            _requests.erase(p);
+            if (took > 100) {
+                qDebug() << "async request" << kind << "took" << took << "ms";
+            }
 
-            case MPV_EVENT_COMMAND_REPLY:
-                if (ev->error < 0) {
-                    qDebug() << "command error";
-                }
+            // superseded or cancelled meanwhile
+            if (_latestRequests.value(kind) != rec.tag) break;
+            _latestRequests.remove(kind);
+            processReply(kind, rec.error);
+            break;
+        }
 
-                if (ev->reply_userdata == AsyncReplyTag::SEEK) {
-                    this->_pendingSeek = false;
-                }
-                break;
+        case MPV_EVENT_PLAYBACK_RESTART:
+            // caused by seek or just playing
+            if (_burstSeeking) {
+                qDebug() << "seek finished" << _burstShotPos;
+                shootBurstFrame();
+            }
+            break;
 
-            case MPV_EVENT_PLAYBACK_RESTART:
-                // caused by seek or just playing
-                break;
+        case MPV_EVENT_TRACKS_CHANGED: {
+            // read on the event thread right before this was queued
+            QMutexLocker lock(&_tracksLock);
+            _pmf = _pendingPmf;
+            lock.unlock();
+            emit tracksChanged();
+            break;
+        }
 
-            case MPV_EVENT_TRACKS_CHANGED:
-                qDebug() << mpv_event_name(ev->event_id);
-                updatePlayingMovieInfo();
-                emit tracksChanged();
-                break;
+        case MPV_EVENT_FILE_LOADED:
+            // got here without loadFile()
+            if (_advancing) {
+                _advancing = false;
+                _pendingLoad.clear();
+                loadExternalSubs();
+            }
+            if (_switchTimer.isValid()) {
+                qDebug() << "file switch took" << _switchTimer.elapsed() << "ms";
+                _switchTimer.invalidate();
+            }
 
-            case MPV_EVENT_FILE_LOADED:
-                qDebug() << mpv_event_name(ev->event_id);
+            // notifications of the new file come only after this, too late
+            // for whoever asks on fileLoaded
+            fetchFileMirror();
+            setState(PlayState::Playing); //might paused immediately
+            emit fileLoaded(urlOfPath(query("path").toString()));
+            break;
 
-                if (_gl_widget) {
-                    auto w = get_property(_handle, "width").toInt();
-                    auto h = get_property(_handle, "height").toInt();
+        case MPV_EVENT_VIDEO_RECONFIG: {
+            auto sz = videoSize();
+            if (!sz.isEmpty())
+                emit videoSizeChanged();
+            qDebug() << "videoSize " << sz;
+            break;
+        }
 
-                    qDebug() << "hwdec-interop" << get_property(_handle, "hwdec-interop");
-                }
-                setState(PlayState::Playing); //might paused immediately
-                emit fileLoaded();
-                qDebug() << QString("rotate metadata: dec %1, out %2")
-                    .arg(get_property(_handle, "video-dec-params/rotate").toInt())
-                    .arg(get_property(_handle, "video-params/rotate").toInt());
-                break;
+        case MPV_EVENT_END_FILE: {
+            resetFileMirror();
+            if (_burstSeeking) {
+                qDebug() << "seek finished (end of file)" << _burstShotPos;
+                shootBurstFrame();
+            }
 
-            case MPV_EVENT_VIDEO_RECONFIG: {
-                auto sz = videoSize();
-                if (!sz.isEmpty())
-                    emit videoSizeChanged();
-                qDebug() << "videoSize " << sz;
+            // ended on request, _file may already be the next one
+            if (_switching) {
+                finishSwitch();
                 break;
             }
-
-            case MPV_EVENT_END_FILE: {
+            // left for the preloaded entry on request
+            if (_advancing) break;
 #ifndef _LIBDMR_
-                MovieConfiguration::get().updateUrl(this->_file,
-                        ConfigKnownKey::StartPos, 0);
+            // out of the way of the records still queued
+            auto url = this->_file;
+            QTimer::singleShot(0, this, [url]() {
+                MovieConfiguration::get().updateUrl(url, ConfigKnownKey::StartPos, 0);
+            });
 #endif
-                mpv_event_end_file *ev_ef = (mpv_event_end_file*)ev->data;
-                qDebug() << mpv_event_name(ev->event_id) << 
-                    "reason " << ev_ef->reason;
-                setState(PlayState::Stopped);
+
+            // mpv goes on with the preloaded entry by itself, gapless if
+            // enabled. there will be no idle in between
+            if (_preloaded.isValid() && (rec.error == MPV_END_FILE_REASON_EOF
+                        || rec.error == MPV_END_FILE_REASON_ERROR)) {
+                _file = _preloaded;
+                _preloaded.clear();
+                _advancing = true;
+                _switchTimer.start();
+                emit advanced(_file);
                 break;
             }
+            setState(PlayState::Stopped);
+            break;
+        }
 
-            case MPV_EVENT_IDLE:
-                qDebug() << mpv_event_name(ev->event_id);
+        case MPV_EVENT_IDLE:
+            _preloaded.clear();
+            _advancing = false;
+            _elapsedTimer.stop();
+            _notifiedSecs = -1;
+            // a stop may end up here without any END_FILE before
+            if (_switching) {
+                finishSwitch();
+            } else {
                 setState(PlayState::Stopped);
-                emit elapsedChanged();
-                break;
+            }
+            emit elapsedChanged();
+            break;
 
-            default:
-                qDebug() << mpv_event_name(ev->event_id);
-                break;
-        }
+        default:
+            break;
+    }
+}
+
+// invalid when the property is unavailable, e.g time-pos while idle
+static inline double eventDouble(const MpvEventRecord& rec)
+{
+    return rec.valid ? rec.value.d : 0.0;
+}
+
+static inline qint64 eventInt(const MpvEventRecord& rec)
+{
+    return rec.valid ? rec.value.i : 0;
+}
+
+static inline bool eventFlag(const MpvEventRecord& rec)
+{
+    return rec.valid ? rec.value.b : false;
+}
+
+void MpvProxy::fetchFileMirror()
+{
+    _mirror.duration = query("duration").toDouble();
+    _mirror.dwidth = query("dwidth").toInt();
+    _mirror.dheight = query("dheight").toInt();
+}
+
+// nothing of the ended file is left over for the next one
+void MpvProxy::resetFileMirror()
+{
+    _mirror.timePos = 0.0;
+    _mirror.duration = 0.0;
+    _mirror.dwidth = 0;
+    _mirror.dheight = 0;
+    _mirror.rotate = 0;
+}
+
+QVariant MpvProxy::query(const char *name) const
+{
+    _syncQueries++;
+    return get_property(_handle, name);
+}
+
+void MpvProxy::reportSyncQueries()
+{
+    if (_state != PlayState::Playing) {
+        _queryClock.invalidate();
+        return;
+    }
+
+    if (!_queryClock.isValid()) {
+        _queryClock.start();
+        _queriesAtClock = _syncQueries;
+    } else if (_queryClock.elapsed() >= 10000) {
+        qDebug() << "sync mpv queries per second of playback:"
+            << (_syncQueries - _queriesAtClock) * 1000.0 / _queryClock.elapsed();
+        _queryClock.restart();
+        _queriesAtClock = _syncQueries;
+    }
+}
+
+// time-pos comes at frame rate, while what's shown of it changes once a second
+void MpvProxy::notifyElapsed()
+{
+    if (_elapsedRate <= 0) {
+        emit elapsedChanged();
+        return;
+    }
+
+    if (elapsed() == _notifiedSecs || _elapsedTimer.isActive()) return;
+
+    auto gap = 1000 / _elapsedRate;
+    if (!_lastNotify.isValid() || _lastNotify.elapsed() >= gap) {
+        flushElapsed();
+    } else {
+        _elapsedTimer.start(gap - _lastNotify.elapsed());
     }
 }
 
-void MpvProxy::processLogMessage(mpv_event_log_message* ev)
+void MpvProxy::flushElapsed()
 {
-    switch (ev->log_level) {
-        case MPV_LOG_LEVEL_WARN: 
-            qWarning() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+    _notifiedSecs = elapsed();
+    _lastNotify.start();
+    emit elapsedChanged();
+}
+
+void MpvProxy::processPropertyChange(const MpvEventRecord& rec)
+{
+    switch (rec.prop) {
+        case MpvProp::TimePos:
+            _mirror.timePos = eventDouble(rec);
+            reportSyncQueries();
+            notifyElapsed();
             break;
 
-        case MPV_LOG_LEVEL_ERROR: 
-        case MPV_LOG_LEVEL_FATAL: 
-            qCritical() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+        case MpvProp::Duration:
+            _mirror.duration = eventDouble(rec);
             break;
 
-        case MPV_LOG_LEVEL_INFO: 
-            qInfo() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+        case MpvProp::IdleActive:
+            _mirror.idle = eventFlag(rec);
             break;
 
-        default:
-            qDebug() << QString("%1: %2").arg(ev->prefix).arg(ev->text);
+        case MpvProp::Volume:
+            _mirror.volume = eventDouble(rec);
+            emit volumeChanged();
             break;
-    }
-}
 
-void MpvProxy::processPropertyChange(mpv_event_property* ev)
-{
-    //if (ev->data == NULL) return;
+        case MpvProp::DWidth:
+        case MpvProp::DHeight:
+        case MpvProp::Rotate: {
+            if (rec.prop == MpvProp::DWidth) _mirror.dwidth = eventInt(rec);
+            else if (rec.prop == MpvProp::DHeight) _mirror.dheight = eventInt(rec);
+            else _mirror.rotate = eventInt(rec);
+
+            auto sz = videoSize();
+            if (!sz.isEmpty())
+                emit videoSizeChanged();
+            qDebug() << "update videoSize " << sz;
+            break;
+        }
 
-    QString name = QString::fromUtf8(ev->name);
-    if (name != "time-pos") qDebug() << name;
+        case MpvProp::Aid:
+            _mirror.aid = eventInt(rec);
+            emit aidChanged();
+            break;
 
-    if (name == "time-pos") {
-        emit elapsedChanged();
-    } else if (name == "volume") {
-        emit volumeChanged();
-    } else if (name == "dwidth" || name == "dheight") {
-        auto sz = videoSize();
-        if (!sz.isEmpty())
-            emit videoSizeChanged();
-        qDebug() << "update videoSize " << sz;
-    } else if (name == "aid") {
-        emit aidChanged();
-    } else if (name == "sid") {
-        if (_externalSubJustLoaded) {
+        case MpvProp::Sid:
+            _mirror.sid = eventInt(rec);
+            if (_externalSubJustLoaded) {
 #ifndef _LIBDMR_
-            MovieConfiguration::get().updateUrl(this->_file, ConfigKnownKey::SubId, sid());
+                MovieConfiguration::get().updateUrl(this->_file, ConfigKnownKey::SubId, sid());
 #endif
-            _externalSubJustLoaded = false;
-        }
-        emit sidChanged();
-    } else if (name == "mute") {
-        emit muteChanged();
-    } else if (name == "sub-visibility") {
-        //_hideSub = get_property(_handle, "sub-visibility")
-    } else if (name == "pause") {
-        auto idle = get_property(_handle, "idle-active").toBool();
-        if (get_property(_handle, "pause").toBool()) {
-            if (!idle)
-                setState(PlayState::Paused);
-            else 
-                set_property(_handle, "pause", false);
-        } else {
-            if (state() != PlayState::Stopped)
-                setState(PlayState::Playing);
-        }
-    } else if (name == "core-idle") {
+                _externalSubJustLoaded = false;
+            }
+            emit sidChanged();
+            break;
+
+        case MpvProp::Mute:
+            _mirror.mute = eventFlag(rec);
+            emit muteChanged();
+            break;
+
+        case MpvProp::Pause:
+            _mirror.pause = eventFlag(rec);
+            if (_mirror.pause) {
+                if (!_mirror.idle)
+                    setState(PlayState::Paused);
+                else 
+                    set_property(_handle, "pause", false);
+            } else {
+                if (state() != PlayState::Stopped)
+                    setState(PlayState::Playing);
+            }
+            break;
+
+        case MpvProp::FrameDrops:
+        case MpvProp::DecoderFrameDrops:
+            // counters restart from 0 with every file
+            if (eventInt(rec) > 0)
+                emit framesDropped();
+            break;
+
+        default:
+            break;
     }
 }
 
@@ -514,7 +822,7 @@ bool MpvProxy::loadSubtitle(const QFileInfo& fi)
 
 bool MpvProxy::isSubVisible()
 {
-    return get_property(_handle, "sub-visibility").toBool();
+    return query("sub-visibility").toBool();
 }
 
 void MpvProxy::setSubDelay(double secs)
@@ -527,12 +835,12 @@ void MpvProxy::setSubDelay(double secs)
 
 double MpvProxy::subDelay() const
 {
-    return get_property(_handle, "sub-delay").toDouble();
+    return query("sub-delay").toDouble();
 }
 
 QString MpvProxy::subCodepage()
 {
-    auto cp = get_property(_handle, "sub-codepage").toString();
+    auto cp = query("sub-codepage").toString();
     if (cp.startsWith("+")) {
         cp.remove(0, 1);
     }
@@ -553,7 +861,7 @@ void MpvProxy::setSubCodepage(const QString& cp)
         cp2.prepend('+');
 
     set_property(_handle, "sub-codepage", cp2);
-    command(_handle, {"sub-reload"});
+    commandAsync(QList<QVariant> {"sub-reload"}, AsyncReplyTag::SUBTITLE);
 #ifndef _LIBDMR_
     if (_file.isValid())
         MovieConfiguration::get().updateUrl(_file, ConfigKnownKey::SubCodepage, subCodepage());
@@ -605,7 +913,7 @@ void MpvProxy::savePlaybackPosition()
 void MpvProxy::setPlaySpeed(double times)
 {
     //set_property(_handle, "speed", times);
-    set_property_async(_handle, "speed", times, AsyncReplyTag::SPEED);
+    setPropertyAsync("speed", times, AsyncReplyTag::SPEED);
 }
 
 void MpvProxy::selectSubtitle(int id)
@@ -614,7 +922,8 @@ void MpvProxy::selectSubtitle(int id)
         id = _pmf.subs.size() == 0? -1: _pmf.subs[0]["id"].toInt();
     }
 
-    set_property(_handle, "sid", id);
+    // saved right below, before mpv reports it back
+    if (set_property(_handle, "sid", id) >= 0) _mirror.sid = id;
 #ifndef _LIBDMR_
     MovieConfiguration::get().updateUrl(_file, ConfigKnownKey::SubId, sid());
 #endif
@@ -631,19 +940,19 @@ void MpvProxy::toggleSubtitle()
 
 int MpvProxy::aid() const
 {
-    return get_property(_handle, "aid").toInt();
+    return _mirror.aid;
 }
 
 int MpvProxy::sid() const
 {
-    return get_property(_handle, "sid").toInt();
+    return _mirror.sid;
 }
 
 void MpvProxy::selectTrack(int id)
 {
     if (id >= _pmf.audios.size()) return;
     auto sid = _pmf.audios[id]["id"];
-    set_property(_handle, "aid", sid);
+    if (set_property(_handle, "aid", sid) >= 0) _mirror.aid = sid.toInt();
 }
 
 void MpvProxy::changeSoundMode(SoundMode sm)
@@ -659,37 +968,37 @@ void MpvProxy::changeSoundMode(SoundMode sm)
             args << "af" << "add" << "@sm:channels=2:[0-1:1-1]"; break;
     }
 
-    command_async(_handle, args, AsyncReplyTag::CHANNEL);
+    commandAsync(args, AsyncReplyTag::CHANNEL);
 }
 
 void MpvProxy::volumeUp()
 {
     QList<QVariant> args = { "add", "volume", 8 };
     qDebug () << args;
-    command(_handle, args);
+    commandAsync(args, AsyncReplyTag::VOLUME);
 }
 
 void MpvProxy::changeVolume(int val)
 {
     val = qMin(qMax(val, 0), 200);
-    set_property(_handle, "volume", val);
+    if (set_property(_handle, "volume", val) >= 0) _mirror.volume = val;
 }
 
 void MpvProxy::volumeDown()
 {
     QList<QVariant> args = { "add", "volume", -8 };
     qDebug () << args;
-    command(_handle, args);
+    commandAsync(args, AsyncReplyTag::VOLUME);
 }
 
 int MpvProxy::volume() const
 {
-    return get_property(_handle, "volume").toInt();
+    return (int)_mirror.volume;
 }
 
 int MpvProxy::videoRotation() const
 {
-    auto vr = get_property(_handle, "video-rotate").toInt();
+    auto vr = query("video-rotate").toInt();
     return (vr + 360) % 360;
 }
 
@@ -705,33 +1014,33 @@ void MpvProxy::setVideoAspect(double r)
 
 double MpvProxy::videoAspect() const
 {
-    return get_property(_handle, "video-aspect").toDouble();
+    return query("video-aspect").toDouble();
 }
 
 bool MpvProxy::muted() const
 {
-    return get_property(_handle, "mute").toBool();
+    return _mirror.mute;
 }
 
 void MpvProxy::toggleMute()
 {
     QList<QVariant> args = { "cycle", "mute" };
     qDebug () << args;
-    command(_handle, args);
+    commandAsync(args, AsyncReplyTag::VOLUME);
 }
 
-void MpvProxy::play()
+QList<QVariant> MpvProxy::loadArgs(const QUrl& url, bool append)
 {
     QList<QVariant> args = { "loadfile" };
     QStringList opts = { };
 
-    if (_file.isLocalFile()) {
-        args << QFileInfo(_file.toLocalFile()).absoluteFilePath();
+    if (url.isLocalFile()) {
+        args << QFileInfo(url.toLocalFile()).absoluteFilePath();
     } else {
-        args << _file.url();
+        args << url.url();
     }
 #ifndef _LIBDMR_
-    auto cfg = MovieConfiguration::get().queryByUrl(_file);
+    auto cfg = MovieConfiguration::get().queryByUrl(url);
     auto key = MovieConfiguration::knownKey2String(ConfigKnownKey::StartPos);
     if (Settings::get().isSet(Settings::ResumeFromLast) && cfg.contains(key)) {
         opts << QString("start=%1").arg(cfg[key].toInt());
@@ -752,15 +1061,55 @@ void MpvProxy::play()
     }
 #endif
 
-    if (opts.size()) {
+    if (append) {
+        args << "append";
+        if (opts.size()) args << opts.join(',');
+    } else if (opts.size()) {
         //opts << "sub-auto=fuzzy";
         args << "replace" << opts.join(',');
     }
 
+    return args;
+}
+
+void MpvProxy::play()
+{
+    auto args = loadArgs(_file, false);
+
+    // already opened by mpv as the next playlist entry, just move on to it
+    if (_file == _preloaded && _state != PlayState::Stopped && !_switching) {
+        qDebug() << "switch to preloaded" << _file;
+        _preloaded.clear();
+        _advancing = true;
+        _pendingLoad = args; // in case mpv has lost it
+        _switchTimer.start();
+        commandAsync(QList<QVariant> {"playlist-next", "force"}, AsyncReplyTag::NEXT);
+        return;
+    }
+
+    // the current file is still being torn down, go on once it's gone
+    if (_switching) {
+        _pendingLoad = args;
+        return;
+    }
+
+    loadFile(args);
+}
+
+void MpvProxy::loadFile(const QList<QVariant>& args)
+{
     qDebug () << args;
-    command(_handle, args);
-    set_property(_handle, "pause", _pauseOnStart);
+    // replace drops the preloaded entry too
+    _preloaded.clear();
+    cancelRequest(AsyncReplyTag::PRELOAD);
+    // a load still in flight is superseded, only the last one counts
+    commandAsync(args, AsyncReplyTag::LOAD);
+    setPropertyAsync("pause", _pauseOnStart, AsyncReplyTag::PROPERTY);
+    loadExternalSubs();
+}
 
+void MpvProxy::loadExternalSubs()
+{
 #ifndef _LIBDMR_
     // by giving a period of time, movie will be loaded and auto-loaded subs are 
     // all ready, then load extra subs from db
@@ -797,7 +1146,33 @@ void MpvProxy::stop()
 {
     QList<QVariant> args = { "stop" };
     qDebug () << args;
-    command(_handle, args);
+    _preloaded.clear();
+    cancelRequest(AsyncReplyTag::PRELOAD);
+    commandAsync(args, AsyncReplyTag::STOP);
+}
+
+void MpvProxy::preload(const QUrl& url)
+{
+    if (url == _preloaded) return;
+    if (_state == PlayState::Stopped || _switching || _advancing) return;
+
+#ifndef _LIBDMR_
+    setPropertyAsync("gapless-audio", Settings::get().isSet(Settings::Gapless) ? "yes" : "no",
+            AsyncReplyTag::PROPERTY);
+#endif
+
+    // keeps only the current entry
+    commandAsync(QList<QVariant> {"playlist-clear"}, AsyncReplyTag::PLAYLIST);
+    _preloaded.clear();
+    cancelRequest(AsyncReplyTag::PRELOAD);
+    if (!url.isValid()) return;
+
+    auto args = loadArgs(url, true);
+    qDebug() << "preload" << args;
+    // taken back if mpv refuses it, see processReply()
+    if (commandAsync(args, AsyncReplyTag::PRELOAD)) {
+        _preloaded = url;
+    }
 }
 
 QImage MpvProxy::takeScreenshot()
@@ -805,7 +1180,7 @@ QImage MpvProxy::takeScreenshot()
     return takeOneScreenshot();
 }
 
-void MpvProxy::burstScreenshot()
+void MpvProxy::burstScreenshot(const QSize& size)
 {
     if (_inBurstShotting) {
         qWarning() << "already in burst screenshotting mode";
@@ -816,7 +1191,7 @@ void MpvProxy::burstScreenshot()
         return;
 
     //command(_handle, QList<QVariant> {"revert-seek", "mark"});
-     _posBeforeBurst = get_property(_handle, "time-pos");
+     _posBeforeBurst = _mirror.timePos;
 
     int d = duration() / 15;
 
@@ -836,11 +1211,86 @@ void MpvProxy::burstScreenshot()
     }
     qDebug() << "burst span " << _burstPoints;
 
-    if (!paused()) pauseResume();
     _inBurstShotting = true;
+    if (_file.isLocalFile()) {
+        burstOffscreen(_file.toLocalFile(), size);
+        return;
+    }
+
+    if (!paused()) pauseResume();
     QTimer::singleShot(0, this, &MpvProxy::stepBurstScreenshot);
 }
 
+using BurstFrames = QList<QPair<QImage, qint64>>;
+
+// every worker decodes its share of the points in order, so it only seeks
+// forward within its own file context
+static BurstFrames extractBurstFrames(const QString& file, const QList<qint64>& points,
+        const QSize& size, std::shared_ptr<QAtomicInt> cancel)
+{
+    BurstFrames frames;
+    FrameDecoder d;
+    d.setInterruptCallback([=]() { return cancel->load() != 0; });
+    if (!d.open(file)) return frames;
+
+    // one that fails, near the end say, leaves a gap and no more
+    for (auto pos: points) {
+        qint64 at = 0;
+        auto img = d.frameAt(pos * 1000, size, Qt::IgnoreAspectRatio, &at);
+        if (img.isNull()) continue;
+        // where the very frame is, to decode it full sized when it's saved
+        img.setText("pts", QString::number(at));
+        frames.append(qMakePair(img, pos));
+    }
+    return frames;
+}
+
+void MpvProxy::burstOffscreen(const QString& file, const QSize& size)
+{
+    auto cancel = std::make_shared<QAtomicInt>(0);
+    _burstCancel = cancel;
+
+    QList<qint64> points;
+    while (_burstStart < _burstPoints.size()) {
+        points.append(nextBurstShootPoint());
+    }
+
+    // a few decoders, each with a contiguous run of points
+    int n = qBound(1, QThread::idealThreadCount(), 4);
+    QList<QList<qint64>> runs;
+    for (int i = 0; i < n; i++) {
+        runs.append(points.mid(i * points.size() / n,
+                    (i + 1) * points.size() / n - i * points.size() / n));
+    }
+
+    QElapsedTimer t;
+    t.start();
+    auto *watcher = new QFutureWatcher<BurstFrames>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [=]() {
+        watcher->deleteLater();
+        // stopped meanwhile
+        if (_burstCancel != cancel) return;
+
+        BurstFrames frames;
+        for (const auto& r: watcher->future().results()) {
+            frames += r;
+        }
+        qDebug() << "burst of" << frames.size() << "frames took" << t.elapsed() << "ms";
+
+        for (const auto& f: frames) {
+            if (_burstCancel != cancel) return;
+            emit notifyScreenshot(f.first, f.second);
+        }
+        if (_burstCancel == cancel && frames.size() < points.size())
+            emit notifyScreenshot(QImage(), 0);
+    });
+
+    std::function<BurstFrames(const QList<qint64>&)> extract = [=](const QList<qint64>& run) {
+        return extractBurstFrames(file, run, size, cancel);
+    };
+    watcher->setFuture(QtConcurrent::mapped(runs, extract));
+}
+
 qint64 MpvProxy::nextBurstShootPoint()
 {
     auto next = _burstPoints[_burstStart++];
@@ -864,40 +1314,56 @@ QImage MpvProxy::takeOneScreenshot()
         return QImage();
     }
 
-    node_autofree f(&res);
+    auto img = imageFromScreenshot(&res);
+    if (img.isNull()) qDebug() << "failed";
+    return img;
+}
 
-    Q_ASSERT(res.format == MPV_FORMAT_NODE_MAP);
+static void freeScreenshotNode(void *info)
+{
+    auto *node = static_cast<mpv_node*>(info);
+    mpv_free_node_contents(node);
+    delete node;
+}
 
-    int w,h,stride;
+QImage MpvProxy::imageFromScreenshot(mpv_node *res)
+{
+    if (res->format != MPV_FORMAT_NODE_MAP) {
+        mpv_free_node_contents(res);
+        return QImage();
+    }
 
-    mpv_node_list *list = res.u.list;
+    int w = 0, h = 0, stride = 0;
     uchar *data = NULL;
 
+    mpv_node_list *list = res->u.list;
     for (int n = 0; n < list->num; n++) {
-        auto key = QString::fromUtf8(list->keys[n]);
-        if (key == "w") {
-            w = list->values[n].u.int64;
-        } else if (key == "h") {
-            h = list->values[n].u.int64;
-        } else if (key == "stride") {
-            stride = list->values[n].u.int64;
-        } else if (key == "format") {
-            auto format = QString::fromUtf8(list->values[n].u.string);
-            qDebug() << "format" << format;
-        } else if (key == "data") {
-            data = (uchar*)list->values[n].u.ba->data;
+        const char *key = list->keys[n];
+        const auto& v = list->values[n];
+        if (!strcmp(key, "w")) {
+            w = v.u.int64;
+        } else if (!strcmp(key, "h")) {
+            h = v.u.int64;
+        } else if (!strcmp(key, "stride")) {
+            stride = v.u.int64;
+        } else if (!strcmp(key, "format")) {
+            if (strcmp(v.u.string, "bgr0"))
+                qWarning() << "unexpected screenshot format" << v.u.string;
+        } else if (!strcmp(key, "data")) {
+            data = (uchar*)v.u.ba->data;
         }
     }
 
-    if (data) {
-        //alpha should be ignored
-        auto img = QImage((const uchar*)data, w, h, stride, QImage::Format_RGB32);
-        img.bits();
-        return img;
+    if (!data || w <= 0 || h <= 0) {
+        mpv_free_node_contents(res);
+        return QImage();
     }
 
-    qDebug() << "failed";
-    return QImage();
+    // the node only refers to what it owns, so a copy of it takes the
+    // pixels over. they're freed with the last copy of the image
+    //alpha should be ignored
+    auto *owner = new mpv_node(*res);
+    return QImage(data, w, h, stride, QImage::Format_RGB32, freeScreenshotNode, owner);
 }
 
 void MpvProxy::stepBurstScreenshot()
@@ -906,32 +1372,27 @@ void MpvProxy::stepBurstScreenshot()
         return;
     }
 
-    auto pos = nextBurstShootPoint();
-    command(_handle, QList<QVariant> {"seek", pos, "absolute"});
-    int tries = 10;
-    while (tries) {
-        mpv_event* ev = mpv_wait_event(_handle, 0.005);
-        if (ev->event_id == MPV_EVENT_NONE) 
-            continue;
-
-        if (ev->event_id == MPV_EVENT_PLAYBACK_RESTART) {
-            qDebug() << "seek finished" << elapsed();
-            break;
-        }
+    // shot when mpv reports the seek done, see processEvent()
+    _burstShotPos = nextBurstShootPoint();
+    _burstSeeking = true;
+    if (!commandAsync(QList<QVariant> {"seek", _burstShotPos, "absolute"}, AsyncReplyTag::SEEK)) {
+        shootBurstFrame();
+    }
+}
 
-        if (ev->event_id == MPV_EVENT_END_FILE) {
-            qDebug() << "seek finished (end of file)" << elapsed();
-            break;
-        }
+void MpvProxy::shootBurstFrame()
+{
+    _burstSeeking = false;
+    if (!_inBurstShotting) {
+        return;
     }
 
     QImage img = takeOneScreenshot();
+    emit notifyScreenshot(img, _burstShotPos);
     if (img.isNull()) {
-        emit notifyScreenshot(img, elapsed());
         stopBurstScreenshot();
         return;
     }
-    emit notifyScreenshot(img, elapsed());
 
     QTimer::singleShot(0, this, &MpvProxy::stepBurstScreenshot);
 }
@@ -939,6 +1400,14 @@ void MpvProxy::stepBurstScreenshot()
 void MpvProxy::stopBurstScreenshot()
 {
     _inBurstShotting = false;
+    _burstSeeking = false;
+    // playback was never touched
+    if (_burstCancel) {
+        _burstCancel->store(1);
+        _burstCancel.reset();
+        return;
+    }
+
     //command(_handle, QList<QVariant> {"revert-seek", "mark"});
     set_property(_handle, "time-pos", _posBeforeBurst);
 }
@@ -950,7 +1419,7 @@ void MpvProxy::seekForward(int secs)
     //if (_pendingSeek) return;
     QList<QVariant> args = { "seek", QVariant(secs), "relative+keyframes" };
     qDebug () << args;
-    command_async(_handle, args, AsyncReplyTag::SEEK);
+    commandAsync(args, AsyncReplyTag::SEEK);
     _pendingSeek = true;
 }
 
@@ -962,7 +1431,7 @@ void MpvProxy::seekBackward(int secs)
     if (secs > 0) secs = -secs;
     QList<QVariant> args = { "seek", QVariant(secs), "relative+keyframes" };
     qDebug () << args;
-    command_async(_handle, args, AsyncReplyTag::SEEK);
+    commandAsync(args, AsyncReplyTag::SEEK);
     _pendingSeek = true;
 }
 
@@ -975,16 +1444,15 @@ void MpvProxy::seekAbsolute(int pos)
     qDebug () << args;
     //command(_handle, args);
     _pendingSeek = true;
-    command_async(_handle, args, AsyncReplyTag::SEEK);
+    commandAsync(args, AsyncReplyTag::SEEK);
 }
 
 QSize MpvProxy::videoSize() const
 {
     if (state() == PlayState::Stopped) return QSize(-1, -1);
-    auto sz = QSize(get_property(_handle, "dwidth").toInt(),
-            get_property(_handle, "dheight").toInt());
+    auto sz = QSize(_mirror.dwidth, _mirror.dheight);
 
-    auto r = get_property(_handle, "video-out-params/rotate").toInt();
+    auto r = _mirror.rotate;
     if (r == 90 || r == 270) {
         sz.transpose();
     }
@@ -994,14 +1462,14 @@ QSize MpvProxy::videoSize() const
 
 qint64 MpvProxy::duration() const
 {
-    return get_property(_handle, "duration").value<qint64>();
+    return (qint64)_mirror.duration;
 }
 
 
 qint64 MpvProxy::elapsed() const
 {
     if (state() == PlayState::Stopped) return 0;
-    return get_property(_handle, "time-pos").value<qint64>();
+    return (qint64)_mirror.timePos;
 }
 
 void MpvProxy::changeProperty(const QString& name, const QVariant& v)
@@ -1010,9 +1478,9 @@ void MpvProxy::changeProperty(const QString& name, const QVariant& v)
 
 void MpvProxy::updatePlayingMovieInfo()
 {
-    _pmf.subs.clear();
-    _pmf.audios.clear();
+    PlayingMovieInfo pmf;
 
+    // on the event thread, not counted as a query of the gui
     auto v = get_property(_handle, "track-list").toList();
     auto p = v.begin();
     while (p != v.end()) {
@@ -1035,7 +1503,7 @@ void MpvProxy::updatePlayingMovieInfo()
             }
 
 
-            _pmf.audios.append(ai);
+            pmf.audios.append(ai);
         } else if (t["type"] == "sub") {
             SubtitleInfo si;
             si["type"] = t["type"];
@@ -1051,13 +1519,16 @@ void MpvProxy::updatePlayingMovieInfo()
                 else if (!t["external"].toBool())
                     si["title"] = tr("[internal]");
             }
-            _pmf.subs.append(si);
+            pmf.subs.append(si);
         }
         ++p;
     }
 
-    qDebug() << _pmf.subs;
-    qDebug() << _pmf.audios;
+    qDebug() << pmf.subs;
+    qDebug() << pmf.audios;
+
+    QMutexLocker lock(&_tracksLock);
+    _pendingPmf = pmf;
 }
 
 void MpvProxy::nextFrame()
@@ -1065,7 +1536,7 @@ void MpvProxy::nextFrame()
     if (state() == PlayState::Stopped) return;
 
     QList<QVariant> args = { "frame-step"};
-    command(_handle, args);
+    commandAsync(args, AsyncReplyTag::STEP);
 }
 
 void MpvProxy::previousFrame()
@@ -1073,12 +1544,12 @@ void MpvProxy::previousFrame()
     if (state() == PlayState::Stopped) return;
 
     QList<QVariant> args = { "frame-back-step"};
-    command(_handle, args);
+    commandAsync(args, AsyncReplyTag::STEP);
 }
 
 QVariant MpvProxy::getProperty(const QString& name)
 {
-    return get_property(_handle, name.toUtf8().data());
+    return query(name.toUtf8().constData());
 }
 
 void MpvProxy::setProperty(const QString& name, const QVariant& val)
@@ -35,10 +35,13 @@
 #include <xcb/xproto.h>
 #undef Bool
 #include <mpv/qthelper.hpp>
+#include <memory>
 
 namespace dmr {
 using namespace mpv::qt;
 class MpvGLWidget;
+class MpvEventThread;
+struct MpvEventRecord;
 
 class MpvProxy: public Backend {
     Q_OBJECT
@@ -51,10 +54,15 @@ public:
     // mpv plays all files by default  (I hope)
     bool isPlayable() const override { return true; }
 
-    // polling until current playback ended
-    void pollingEndOfPlayback();
-    // polling until current playback started
-    void pollingStartOfPlayback();
+    // stops current playback without waiting for it. a play() before mpv
+    // reports the end is held back and issued right then
+    void endPlayback();
+
+    // opens url as mpv's next playlist entry, so play() of it or the end
+    // of the current file moves on without tearing anything down. an
+    // invalid url drops what was preloaded
+    void preload(const QUrl& url);
+    const QUrl& preloaded() const { return _preloaded; }
 
     qint64 duration() const override;
     qint64 elapsed() const override;
@@ -87,10 +95,22 @@ public:
     void setVideoRotation(int degree) override;
 
     QImage takeScreenshot() override;
-    void burstScreenshot() override; //initial the start of burst screenshotting
+    // wraps the result of screenshot-raw and takes it over, pixels are
+    // used in place and freed along with the image
+    static QImage imageFromScreenshot(mpv_node *res);
+    // local files are shot by decoders of their own, without touching
+    // playback. others by seeking the player around
+    void burstScreenshot(const QSize& size = QSize()) override;
     void stopBurstScreenshot() override;
 
     QVariant getProperty(const QString&) override;
+    // synchronous mpv queries made so far, getters of observed
+    // properties don't make any
+    int syncQueries() const { return _syncQueries; }
+
+    // elapsedChanged is emitted only when the elapsed second changes, and
+    // at most hz times a second. 0 emits it for every time-pos update
+    void setElapsedRate(int hz) { _elapsedRate = hz; }
     void setProperty(const QString&, const QVariant&) override;
 
     void nextFrame() override;
@@ -115,10 +135,16 @@ protected:
 
 protected slots:
     void handle_mpv_events();
+    void loadFile(const QList<QVariant>& args);
+    void finishSwitch();
+    void flushElapsed();
+    void loadExternalSubs();
     void stepBurstScreenshot();
 
 signals:
     void has_mpv_events();
+    // current file ended and mpv went on with the preloaded url by itself
+    void advanced(const QUrl& url);
 
 private:
     Handle _handle;
@@ -128,12 +154,45 @@ private:
     QVariant _posBeforeBurst;
     qint64 _burstStart {0};
     QList<qint64> _burstPoints;
+    // seeking to _burstShotPos, shot once mpv restarts playback there
+    bool _burstSeeking {false};
+    qint64 _burstShotPos {0};
+    // set for an offscreen burst, raised to make it give up
+    std::shared_ptr<QAtomicInt> _burstCancel;
 
     bool _pendingSeek {false};
     PlayingMovieInfo _pmf;
+    // read on the event thread, taken over with its TRACKS_CHANGED record
+    QMutex _tracksLock;
+    PlayingMovieInfo _pendingPmf;
+
+    MpvEventThread *_events {nullptr};
+
+    // async requests in flight by reply_userdata, see commandAsync()
+    struct AsyncRequest {
+        int kind;
+        QElapsedTimer issued;
+    };
+    QHash<quint64, AsyncRequest> _requests;
+    QHash<int, quint64> _latestRequests; // the one reply of a kind that counts
+    quint64 _lastRequestId {0};
+    // handling latency and queue depth, logged every 10s
+    int _eventCount {0};
+    qint64 _latencySum {0};
+    qint64 _latencyMax {0};
+    int _depthMax {0};
+    QElapsedTimer _eventClock;
     int _videoRotation {0};
 
-    bool _polling {false};
+    // a file switch in progress, see endPlayback()
+    bool _switching {false};
+    QList<QVariant> _pendingLoad;
+    QElapsedTimer _switchTimer;
+    QTimer _switchTimeout; // gives up waiting for mpv to report the end
+
+    QUrl _preloaded;
+    // on the way into the preloaded entry, ended file is not reported
+    bool _advancing {false};
 
     bool _externalSubJustLoaded {false};
 
@@ -141,14 +200,54 @@ private:
 
     bool _pauseOnStart {false};
 
+    // observed properties as last reported by mpv
+    struct {
+        double timePos {0.0};
+        double duration {0.0};
+        double volume {0.0};
+        bool pause {false};
+        bool idle {true};
+        bool mute {false};
+        int sid {0};
+        int aid {0};
+        int dwidth {0};
+        int dheight {0};
+        int rotate {0};
+    } _mirror;
+
+    // every synchronous get_property, logged per second of playback
+    mutable int _syncQueries {0};
+    int _queriesAtClock {0};
+    QElapsedTimer _queryClock;
+
+    int _elapsedRate {4};
+    qint64 _notifiedSecs {-1};
+    QElapsedTimer _lastNotify;
+    QTimer _elapsedTimer; // trailing notification when rate limited
+
     mpv_handle* mpv_init();
-    void processPropertyChange(mpv_event_property* ev);
-    void processLogMessage(mpv_event_log_message* ev);
+    void processEvent(const MpvEventRecord& rec);
+    void processReply(int kind, int error);
+    quint64 trackRequest(int kind);
+    quint64 commandAsync(const QList<QVariant>& args, int kind);
+    quint64 setPropertyAsync(const char *name, const QVariant& v, int kind);
+    void cancelRequest(int kind);
+    void processPropertyChange(const MpvEventRecord& rec);
+    void reportEventStats();
+    QVariant query(const char *name) const;
+    // per file part of _mirror
+    void fetchFileMirror();
+    void resetFileMirror();
+    void reportSyncQueries();
+    void notifyElapsed();
     QImage takeOneScreenshot();
+    void shootBurstFrame();
+    QList<QVariant> loadArgs(const QUrl& url, bool append);
     void changeProperty(const QString& name, const QVariant& v);
     void updatePlayingMovieInfo();
     void setState(PlayState s);
     qint64 nextBurstShootPoint();
+    void burstOffscreen(const QString& file, const QSize& size);
 };
 }
 
@@ -87,6 +87,7 @@ static QString flag2key(Settings::Flag f)
         case Settings::Flag::MultipleInstance: return "multiinstance";
         case Settings::Flag::PauseOnMinimize: return "pauseonmin";
         case Settings::Flag::HWAccel: return "hwaccel";
+        case Settings::Flag::Gapless: return "gapless";
     }
 
 }
@@ -51,6 +51,7 @@ class Settings: public QObject {
             MultipleInstance,
             PauseOnMinimize,
             HWAccel,
+            Gapless,
         };
 
         static Settings& get();
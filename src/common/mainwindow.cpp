@@ -702,8 +702,10 @@ MainWindow::MainWindow(QWidget *parent)
     });
 
     connect(_engine, &PlayerEngine::fileLoaded, [=]() {
-        if (windowState() == Qt::WindowNoState && _lastRectInNormalMode.isValid()) {
-            const auto& mi = _engine->playlist().currentInfo().mi;
+        const auto& pl = _engine->playlist();
+        if (windowState() == Qt::WindowNoState && _lastRectInNormalMode.isValid()
+                && pl.count() > 0 && pl.current() >= 0) {
+            const auto& mi = pl.currentInfo().mi;
             _lastRectInNormalMode.setSize({mi.width, mi.height});
         }
         this->resizeByConstraints();
@@ -1539,7 +1541,8 @@ void MainWindow::requestAction(ActionFactory::ActionKind kd, bool fromUI,
 
         case ActionFactory::ActionKind::MovieInfo: {
             if (_engine->state() != PlayerEngine::CoreState::Idle) {
-                MovieInfoDialog mid(_engine->playlist().currentInfo());
+                const auto& pif = _engine->playlist().currentInfo();
+                MovieInfoDialog mid(pif, _engine->playlist().loadThumbnail(pif.url));
                 mid.exec();
             }
             break;
@@ -1972,9 +1975,9 @@ void MainWindow::onBurstScreenshot(const QImage& frame, qint64 timestamp)
         _toolbox->setEnabled(true);
         if (_listener) _listener->setEnabled(!_miniMode);
 
-        if (frame.isNull()) {
-            _burstShoots.clear();
-            if (!_pausedBeforeBurst)
+        // a burst cut short shows what it got
+        if (_burstShoots.isEmpty()) {
+            if (!_pausedBeforeBurst && _engine->paused())
                 _engine->pauseResume();
             return;
         }
@@ -1985,7 +1988,8 @@ void MainWindow::onBurstScreenshot(const QImage& frame, qint64 timestamp)
         qDebug() << "BurstScreenshot done";
 
         _burstShoots.clear();
-        if (!_pausedBeforeBurst)
+        // playback is only paused when the burst was shot by seeking it
+        if (!_pausedBeforeBurst && _engine->paused())
             _engine->pauseResume();
 
         if (ret == QDialog::Accepted) {
@@ -2010,7 +2014,7 @@ void MainWindow::startBurstShooting()
     _pausedBeforeBurst = _engine->paused();
 
     connect(_engine, &PlayerEngine::notifyScreenshot, this, &MainWindow::onBurstScreenshot);
-    _engine->burstScreenshot();
+    _engine->burstScreenshot(BurstScreenshotsDialog::frameSize());
 }
 
 void MainWindow::handleSettings()
@@ -28,141 +28,644 @@
  * files in the program, then also delete it here.
  */
 #include "thumbnail_worker.h"
+#include "frame_decoder.h"
+#include "packed_cache.h"
+#include "playlist_journal.h"
+#include "keyframe_index.h"
 #include <atomic>
+#include <climits>
 #include <mutex>
 
-#define SIZE_THRESHOLD (10 * 1<<20)
+#define DEFAULT_CACHE_BUDGET (10 * 1<<20)
+#define STORYBOARD_TILES 64
+#define STORYBOARD_COLUMNS 8
+#define MAX_STORYBOARD_SIZE (128 << 20)
+#define MAX_STORYBOARD_AGE (90 * 24 * 3600)
+// how far ahead of a moving cursor to decode, and how many
+#define PREDICT_STEP_MS 150
+#define PREDICT_COUNT 3
+// farthest a fast preview is moved to reach a keyframe, msecs
+#define FAST_SNAP_RANGE 5000
 
 namespace dmr {
 static std::atomic<ThumbnailWorker*> _instance { nullptr };
 static QMutex _instLock;
 
-static QMutex _thumbLock;
+// workers only, the gui thread never waits on these for long
+static QMutex _queueLock;
+static QMutex _writeLock;
 static QWaitCondition cond;
 
+// bumped by every read of a preview, for lru
+static QAtomicInt _tick {0};
+
+// prefix of a saved storyboard, followed by the rgb32 pixels of the sheet
+struct SheetHeader {
+    quint32 tiles;
+    quint32 step;
+    quint32 tileWidth;
+    quint32 tileHeight;
+    quint32 bytesPerLine;
+    quint32 reserved[3];
+};
+
+struct ThumbnailWorker::Request {
+    ThumbKey key;
+    QList<ThumbKey> ahead;
+    int generation;
+};
+
+// a decode being run by a worker. generation is 0 for prefetches, which
+// nothing supersedes
+struct ThumbnailWorker::Job {
+    ThumbKey key;
+    QAtomicInt generation {0};
+    bool grid {false};
+};
+
+struct ThumbnailWorker::Entry {
+    QPixmap pm;
+    int cost;
+    QAtomicInt used {0};
+};
+
+// tiles are laid out row by row, STORYBOARD_COLUMNS per row. until all of
+// them are decoded they are kept apart in parts, then joined into sheet
+struct ThumbnailWorker::Storyboard {
+    QUrl url;
+    FileIdentity id {0, 0, 0, 0};
+    int duration {0};
+    int step {0};
+    int tiles {0};
+    QSize tile;
+    QImage sheet;
+    QVector<QImage> parts;
+    int missing {0};    // 0 once complete
+
+    int tileAt(int secs) const { return qBound(0, secs / step, tiles - 1); }
+    int tileTime(int i) const { return i * step + step / 2; }
+    QRect tileRect(int i) const {
+        return QRect(QPoint(i % STORYBOARD_COLUMNS * tile.width(),
+                    i / STORYBOARD_COLUMNS * tile.height()), tile);
+    }
+    bool hasTile(int i) const { return !sheet.isNull() || !parts.value(i).isNull(); }
+    QImage tileImage(int i) const { return sheet.isNull() ? parts.value(i) : sheet.copy(tileRect(i)); }
+};
+
+// never modified once published, pixmaps and images are shared between
+// consecutive snapshots
+struct ThumbnailWorker::Snapshot {
+    QHash<ThumbKey, std::shared_ptr<Entry>> thumbs;
+    int bytes {0};
+    int budget {DEFAULT_CACHE_BUDGET};
+    Storyboard board;   // of the playing file
+};
+
+static QByteArray storyboardKey(const FileIdentity& id)
+{
+    return QByteArray(1, 's') + QByteArray((const char*)&id, sizeof id);
+}
+
+// the saved sheet for b, pixels point into the mapping of the pack, which
+// the image keeps. null if there is none or it was made for another tile size
+QImage ThumbnailWorker::mapSheet(const Storyboard& b) const
+{
+    PackedCache::Hold hold;
+    auto data = _pack->find(storyboardKey(b.id), &hold);
+    if (data.size() < (int)sizeof(SheetHeader)) return QImage();
+
+    auto *h = (const SheetHeader*)data.constData();
+    auto rows = (h->tiles + STORYBOARD_COLUMNS - 1) / STORYBOARD_COLUMNS;
+    if (h->tiles != (quint32)b.tiles || h->step != (quint32)b.step
+            || h->tileWidth != (quint32)b.tile.width() || h->tileHeight != (quint32)b.tile.height()
+            || data.size() < (int)(sizeof(SheetHeader) + h->bytesPerLine * rows * h->tileHeight))
+        return QImage();
+
+    return QImage((const uchar*)data.constData() + sizeof(SheetHeader),
+            STORYBOARD_COLUMNS * h->tileWidth, rows * h->tileHeight,
+            h->bytesPerLine, QImage::Format_RGB32,
+            PackedCache::releaseHold, new PackedCache::Hold(hold));
+}
+
+class ThumbThread: public QThread {
+public:
+    ThumbThread(ThumbnailWorker *w): _w(w) {}
+
+protected:
+    void run() override { _w->work(); }
+
+private:
+    ThumbnailWorker *_w;
+};
+
 ThumbnailWorker& ThumbnailWorker::get()
 {
     if (_instance == nullptr) {
         QMutexLocker lock(&_instLock);
         if (_instance == nullptr) {
             _instance = new ThumbnailWorker;
-            (*_instance).start();
         }
     }
 
     return *_instance;
 }
 
-bool ThumbnailWorker::isThumbGenerated(const QUrl& url, int secs)
+std::shared_ptr<const ThumbnailWorker::Snapshot> ThumbnailWorker::snapshot() const
+{
+    return std::atomic_load(&_snap);
+}
+
+// with _writeLock held, s is a modified copy of the current snapshot
+void ThumbnailWorker::publish(Snapshot *s)
 {
-    QMutexLocker lock(&_thumbLock);
-    if (!_cache.contains(url)) return false;
+    std::atomic_store(&_snap, std::shared_ptr<const Snapshot>(s));
+}
 
-    const auto& l = _cache[url];
-    return l.contains(secs);
+bool ThumbnailWorker::isThumbGenerated(const QUrl& url, int secs)
+{
+    return snapshot()->thumbs.contains(qMakePair(url, secs));
 }
 
 QPixmap ThumbnailWorker::getThumb(const QUrl& url, int secs)
 {
-    QMutexLocker lock(&_thumbLock);
-    QPixmap pm;
+    auto s = snapshot();
+    auto e = s->thumbs.value(qMakePair(url, secs));
+    if (!e) {
+        _misses.ref();
+        return QPixmap();
+    }
 
-    if (_cache.contains(url)) {
-        auto p = _cache[url].find(secs);
-        pm = *p;
+    e->used.store(_tick.fetchAndAddRelaxed(1) + 1);
+    _hits.ref();
+    return e->pm;
+}
+
+QPixmap ThumbnailWorker::nearestThumb(const QUrl& url, int *secs)
+{
+    auto s = snapshot();
+    const auto& b = s->board;
+    bool onBoard = b.url == url && b.step > 0;
+    int tolerance = onBoard ? b.step / 2 + 1 : 0;
+
+    std::shared_ptr<Entry> best;
+    int bestAt = 0;
+    int dist = INT_MAX;
+    for (auto it = s->thumbs.constBegin(); it != s->thumbs.constEnd(); ++it) {
+        // failed decodes are cached as null pixmaps, they're no preview
+        if (it.key().first != url || it.value()->pm.isNull()) continue;
+        auto d = qAbs(it.key().second - *secs);
+        if (d <= tolerance && d < dist) {
+            best = it.value();
+            bestAt = it.key().second;
+            dist = d;
+            if (d == 0) break;
+        }
     }
 
+    int tile = -1;
+    if (onBoard) {
+        auto i = b.tileAt(*secs);
+        if (b.hasTile(i) && qAbs(b.tileTime(i) - *secs) < dist) tile = i;
+    }
+
+    QPixmap pm;
+    if (tile >= 0) {
+        pm = QPixmap::fromImage(b.tileImage(tile));
+        pm.setDevicePixelRatio(_dpr);
+        *secs = b.tileTime(tile);
+        _hits.ref();
+    } else if (best) {
+        best->used.store(_tick.fetchAndAddRelaxed(1) + 1);
+        pm = best->pm;
+        *secs = bestAt;
+        _hits.ref();
+    } else {
+        _misses.ref();
+    }
     return pm;
 }
 
+int ThumbnailWorker::previewPosition(const QUrl& url, int secs) const
+{
+    if (!_fast.load()) return secs;
 
-void ThumbnailWorker::requestThumb(const QUrl& url, int secs)
+    auto pos = secs * 1000LL;
+    auto kf = KeyframeIndex::get().nearest(url, pos);
+    if (kf < 0 || qAbs(kf - pos) > FAST_SNAP_RANGE) return secs;
+    return kf / 1000;
+}
+
+void ThumbnailWorker::loadStoryboard(const QUrl& url, int duration)
 {
-    if (_thumbLock.tryLock()) {
-        _wq.push_front(qMakePair(url, secs));
-        cond.wakeOne();
-        _thumbLock.unlock();
-    } 
+    Storyboard b;
+    b.url = url;
+    b.id = fileIdentity(url);
+    if (duration > 0 && b.id.ino != 0) {
+        b.duration = duration;
+        b.tiles = qMin(duration, STORYBOARD_TILES);
+        b.step = duration / b.tiles;
+        b.tile = thumbSize() * _dpr;
+
+        // nothing to decode when it was made before, in this or another session
+        b.sheet = mapSheet(b);
+        if (!b.sheet.isNull()) {
+            qDebug() << "storyboard of" << url << "mapped from cache";
+        } else {
+            b.parts.resize(b.tiles);
+            b.missing = b.tiles;
+        }
+    }
+
+    {
+        QMutexLocker lock(&_writeLock);
+        auto *s = new Snapshot(*snapshot());
+        s->board = b;
+        publish(s);
+    }
+
+    QMutexLocker lock(&_queueLock);
+    _grid.clear();
+    _ahead.clear();
+    if (!b.missing) return;
+
+    // coarse to fine, so an early hover already finds something close
+    QVector<bool> queued(b.tiles, false);
+    int stride = 1;
+    while (stride * 2 < b.tiles) stride *= 2;
+    for (; stride >= 1; stride /= 2) {
+        for (int i = 0; i < b.tiles; i += stride) {
+            if (queued[i]) continue;
+            queued[i] = true;
+            _grid.append(qMakePair(url, b.tileTime(i)));
+        }
+    }
+
+    cond.wakeAll();
 }
 
-ThumbnailWorker::ThumbnailWorker()
+// called by workers for every storyboard position decoded
+void ThumbnailWorker::addTile(const QUrl& url, int secs, const QImage& img)
 {
-    thumber.setThumbnailSize(thumbSize().width() * qApp->devicePixelRatio());
-    thumber.setMaintainAspectRatio(true);
+    // a failed one keeps the storyboard incomplete, so it's not saved and
+    // will be tried again next time
+    if (img.isNull()) return;
+
+    QMutexLocker lock(&_writeLock);
+    auto cur = snapshot();
+    const auto& b = cur->board;
+    if (b.url != url || b.missing == 0) return;
+
+    auto i = b.tileAt(secs);
+    if (b.tileTime(i) != secs || b.hasTile(i)) return;
+
+    // frames come scaled to cover a tile, keep the middle of it
+    QRect src(QPoint(0, 0), b.tile);
+    src.moveCenter(img.rect().center());
+
+    auto *s = new Snapshot(*cur);
+    s->board.parts[i] = img.copy(src);
+    auto done = --s->board.missing == 0;
+    publish(s);
+
+    if (done) {
+        lock.unlock();
+        saveStoryboard();
+    }
 }
 
-QPixmap ThumbnailWorker::genThumb(const QUrl& url, int secs)
+void ThumbnailWorker::saveStoryboard()
 {
-    auto dpr = qApp->devicePixelRatio();
-    QPixmap pm;
-    pm.setDevicePixelRatio(dpr);
+    auto b = snapshot()->board;
 
-    QTime d(0, 0, 0);
-    d = d.addSecs(secs);
-    thumber.setSeekTime(d.toString("hh:mm:ss").toStdString());
-    auto file = QFileInfo(url.toLocalFile()).absoluteFilePath();
-    try {
-        std::vector<uint8_t> buf;
-        thumber.generateThumbnail(file.toUtf8().toStdString(),
-                ThumbnailerImageType::Png, buf);
+    // changed while being decoded, it would be saved under a stale identity
+    if (b.missing != 0 || fileIdentity(b.url) != b.id) return;
 
-        auto img = QImage::fromData(buf.data(), buf.size(), "png");
+    auto rows = (b.tiles + STORYBOARD_COLUMNS - 1) / STORYBOARD_COLUMNS;
+    QImage sheet(STORYBOARD_COLUMNS * b.tile.width(), rows * b.tile.height(),
+            QImage::Format_RGB32);
+    sheet.fill(Qt::black);
+    {
+        QPainter p(&sheet);
+        for (int i = 0; i < b.tiles; i++) {
+            p.drawImage(b.tileRect(i).topLeft(), b.parts[i]);
+        }
+    }
 
-        pm = QPixmap::fromImage(img.scaled(thumbSize() * dpr, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation));
-        pm.setDevicePixelRatio(dpr);
-    } catch (const std::logic_error&) {
+    SheetHeader h {(quint32)b.tiles, (quint32)b.step, (quint32)b.tile.width(),
+        (quint32)b.tile.height(), (quint32)sheet.bytesPerLine(), {0, 0, 0}};
+    QByteArray data((const char*)&h, sizeof h);
+    data.append((const char*)sheet.constBits(), sheet.bytesPerLine() * sheet.height());
+    auto key = storyboardKey(b.id);
+    if (!_pack->insert(key, data)) {
+        // full, make room and try once more
+        _pack->compact(MAX_STORYBOARD_SIZE, MAX_STORYBOARD_AGE);
+        if (!_pack->insert(key, data)) {
+            qWarning() << "failed to save storyboard of" << b.url;
+            return;
+        }
     }
+    qDebug() << "storyboard of" << b.url << "saved," << data.size() << "bytes";
 
-    return pm;
+    // serve it from the mapping instead of keeping the parts around
+    auto mapped = mapSheet(b);
+    if (mapped.isNull()) return;
+
+    QMutexLocker lock(&_writeLock);
+    auto cur = snapshot();
+    if (cur->board.url == b.url && cur->board.id == b.id) {
+        auto *s = new Snapshot(*cur);
+        s->board.sheet = mapped;
+        s->board.parts.clear();
+        publish(s);
+    }
 }
 
-void ThumbnailWorker::run()
+void ThumbnailWorker::setPrefetchPaused(bool paused)
 {
-    setPriority(QThread::IdlePriority);
-    while (!_quit.load()) {
+    QMutexLocker lock(&_queueLock);
+    if (_prefetchPaused == paused) return;
 
-        QPair<QUrl, int> w;
-        {
-            QMutexLocker lock(&_thumbLock);
-            while (_wq.isEmpty() && !_quit.load()) {
-                cond.wait(lock.mutex(), 40);
-            }
+    qDebug() << "thumbnail prefetch" << (paused ? "paused" : "resumed");
+    _prefetchPaused = paused;
+    if (!paused) cond.wakeAll();
+}
 
-            if (!_wq.isEmpty()) {
-                w = _wq.takeFirst();
-                _wq.clear();
-            }
+int ThumbnailWorker::cacheBudget() const
+{
+    return snapshot()->budget;
+}
+
+// with _writeLock held. least recently read ones make room
+void ThumbnailWorker::evict(Snapshot& s, int budget)
+{
+    s.budget = budget;
+    while (s.bytes > s.budget && !s.thumbs.isEmpty()) {
+        auto lru = s.thumbs.begin();
+        for (auto it = s.thumbs.begin(); it != s.thumbs.end(); ++it) {
+            if (it.value()->used.load() < lru.value()->used.load()) lru = it;
         }
+        s.bytes -= lru.value()->cost;
+        s.thumbs.erase(lru);
+        _evictions.ref();
+    }
+}
 
-        if (_quit.load()) break;
-        
-        {
-            QMutexLocker lock(&_thumbLock);
-            //TODO: optimize: need a lru map
-            if (_cacheSize > SIZE_THRESHOLD) {
-                qDebug() << "thumb cache size exceeds maximum, clean up";
-                _cache.clear();
-                _cacheSize = 0;
+void ThumbnailWorker::setCacheBudget(int bytes)
+{
+    QMutexLocker lock(&_writeLock);
+    auto *s = new Snapshot(*snapshot());
+    evict(*s, bytes);
+    publish(s);
+}
+
+void ThumbnailWorker::insertThumb(const ThumbKey& key, const QPixmap& pm)
+{
+    auto e = std::make_shared<Entry>();
+    e->pm = pm;
+    e->cost = qMax(1, pm.width() * pm.height() * pm.depth() / 8);
+    e->used.store(_tick.fetchAndAddRelaxed(1) + 1);
+
+    QMutexLocker lock(&_writeLock);
+    auto *s = new Snapshot(*snapshot());
+    if (auto old = s->thumbs.value(key)) s->bytes -= old->cost;
+    s->thumbs.insert(key, e);
+    s->bytes += e->cost;
+    evict(*s, s->budget);
+    publish(s);
+}
+
+ThumbnailWorker::Stats ThumbnailWorker::stats() const
+{
+    auto s = snapshot();
+    return Stats {_hits.load(), _misses.load(), _evictions.load(), s->thumbs.count(), s->bytes};
+}
+
+void ThumbnailWorker::setPlayingUrl(const QUrl& url)
+{
+    {
+        QMutexLocker lock(&_writeLock);
+        auto *s = new Snapshot(*snapshot());
+        for (auto it = s->thumbs.begin(); it != s->thumbs.end(); ) {
+            if (it.key().first != url) {
+                s->bytes -= it.value()->cost;
+                it = s->thumbs.erase(it);
+            } else {
+                ++it;
             }
         }
+        if (s->board.url != url) s->board = Storyboard();
+        publish(s);
+    }
+
+    QMutexLocker lock(&_queueLock);
+    _ahead.clear();
+    if (!_grid.isEmpty() && _grid.first().first != url) _grid.clear();
+}
 
-        if (!isThumbGenerated(w.first, w.second)) {
-            auto pm = genThumb(w.first, w.second);
+// never blocks: the request replaces whatever is waiting in the mailbox,
+// and bumps the generation so a decode of an older one gives up
+void ThumbnailWorker::requestThumb(const QUrl& url, int secs)
+{
+    auto *r = new Request;
+    r->key = qMakePair(url, secs);
+    r->ahead = predict(url, secs);
+    r->generation = _generation.fetchAndAddOrdered(1) + 1;
+    delete _mailbox.fetchAndStoreOrdered(r);
 
-            QMutexLocker lock(&_thumbLock);
-            _cache[w.first].insert(w.second, pm);
-            _cacheSize += pm.width() * pm.height() * (pm.hasAlpha() ? 4 : 3);
+    // a worker about to wait may miss this, it looks again after 40ms
+    cond.wakeOne();
+}
 
-            QTime d(0, 0, 0);
-            d = d.addSecs(w.second);
-            qDebug() << "thumb for " << w.first << d.toString("hh:mm:ss");
+// positions the cursor is heading to, gui thread only
+QList<ThumbnailWorker::ThumbKey> ThumbnailWorker::predict(const QUrl& url, int secs)
+{
+    QList<ThumbKey> ahead;
+    qint64 dt = -1;
+    if (_hoverClock.isValid()) dt = _hoverClock.restart();
+    else _hoverClock.start();
+    auto last = _lastHover;
+    _lastHover = secs;
+
+    // the cursor stopped or jumped, nothing to follow
+    if (dt <= 0 || dt > 250 || last < 0 || last == secs)
+        return ahead;
+
+    auto s = snapshot();
+    auto duration = s->board.url == url ? s->board.duration : 0;
+    auto v = qreal(secs - last) / dt;
+    auto prev = secs;
+    for (int i = 1; i <= PREDICT_COUNT; i++) {
+        auto p = secs + qRound(v * PREDICT_STEP_MS * i);
+        p = qMax(0, p);
+        if (duration > 0) p = qMin(p, duration - 1);
+        p = previewPosition(url, p);
+        if (p == prev) continue;
+        prev = p;
+
+        auto k = qMakePair(url, p);
+        if (!s->thumbs.contains(k)) ahead.append(k);
+    }
+    return ahead;
+}
+
+// with _queueLock held
+bool ThumbnailWorker::takeWork(Job& job)
+{
+    job.grid = false;
+    job.generation.store(0);
+
+    if (auto *r = _mailbox.fetchAndStoreOrdered(nullptr)) {
+        QScopedPointer<Request> req(r);
+        _ahead = r->ahead;
+
+        // already being made, it just must not be abandoned now. a
+        // storyboard tile never is
+        if (auto *other = _inflight.value(r->key)) {
+            if (!other->grid) other->generation.store(r->generation);
+        } else {
+            job.key = r->key;
+            job.generation.store(r->generation);
+            return true;
         }
+    }
+
+    if (_prefetchPaused) return false;
+
+    auto s = snapshot();
+    while (!_ahead.isEmpty()) {
+        job.key = _ahead.takeFirst();
+        if (!s->thumbs.contains(job.key) && !_inflight.contains(job.key)) return true;
+    }
+
+    // one worker on the storyboard is enough, the others stay free for hovering
+    if (_gridBusy) return false;
+    while (!_grid.isEmpty()) {
+        job.key = _grid.takeFirst();
+        if (!_inflight.contains(job.key)) {
+            job.grid = true;
+            _gridBusy = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThumbnailWorker::stop()
+{
+    _quit.store(1);
+    cond.wakeAll();
+}
+
+ThumbnailWorker::ThumbnailWorker()
+{
+    _dpr = qApp->devicePixelRatio();
+    _snap = std::make_shared<Snapshot>();
+
+    auto dir = QString("%1/%2/%3")
+        .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation))
+        .arg(qApp->organizationName())
+        .arg(qApp->applicationName());
+    QDir().mkpath(dir);
+    _pack = new PackedCache(dir + "/storyboard.pack", 4096);
+
+    // while one worker is still busy with a position the cursor has left,
+    // another one can start on the newest
+    auto n = qBound(1, QThread::idealThreadCount() / 2, 3);
+    for (int i = 0; i < n; i++) {
+        auto *t = new ThumbThread(this);
+        _workers.append(t);
+        t->start(QThread::IdlePriority);
+    }
+}
+
+QImage ThumbnailWorker::genImage(FrameDecoder& decoder, const QUrl& url, int secs)
+{
+    // opening and probing costs most, so the file stays open for as long
+    // as previews of it are requested
+    auto file = QFileInfo(url.toLocalFile()).absoluteFilePath();
+    if (decoder.file() != file && !decoder.open(file)) {
+        return QImage();
+    }
 
-        emit thumbGenerated(w.first, w.second);
+    // a keyframe within the second is decoded alone, instead of decoding
+    // from the one before up to the whole second
+    auto pos = secs * 1000LL;
+    if (_fast.load()) {
+        auto kf = KeyframeIndex::get().next(url, pos);
+        if (kf >= 0 && kf < pos + 1000) pos = kf;
     }
 
-    _wq.clear();
+    return decoder.frameAt(pos, thumbSize() * _dpr, Qt::KeepAspectRatioByExpanding);
 }
 
+QPixmap ThumbnailWorker::genThumb(FrameDecoder& decoder, const QUrl& url, int secs)
+{
+    QPixmap pm;
+    pm.setDevicePixelRatio(_dpr);
+
+    auto img = genImage(decoder, url, secs);
+    if (!img.isNull()) {
+        pm = QPixmap::fromImage(img);
+        pm.setDevicePixelRatio(_dpr);
+    }
+
+    return pm;
 }
 
+// loop of every worker thread
+void ThumbnailWorker::work()
+{
+    FrameDecoder decoder;
+    Job *current = nullptr;
+
+    // a hover request is dropped as soon as a newer one arrives
+    auto obsolete = [=](const Job& j) {
+        auto g = j.generation.load();
+        return g != 0 && g != _generation.load();
+    };
+    decoder.setInterruptCallback([&]() {
+        return _quit.load() || (current && obsolete(*current));
+    });
+
+    while (!_quit.load()) {
+        Job job;
+        {
+            QMutexLocker lock(&_queueLock);
+            while (!_quit.load() && !takeWork(job)) {
+                cond.wait(&_queueLock, 40);
+            }
+
+            if (_quit.load()) break;
+            _inflight.insert(job.key, &job);
+        }
+
+        current = &job;
+        bool abandoned = false;
+        if (job.grid) {
+            addTile(job.key.first, job.key.second, genImage(decoder, job.key.first, job.key.second));
+        } else if (!isThumbGenerated(job.key.first, job.key.second)) {
+            auto pm = genThumb(decoder, job.key.first, job.key.second);
+
+            // failed ones are kept too, so they are not tried over and over
+            abandoned = obsolete(job) || _quit.load();
+            if (!abandoned) {
+                insertThumb(job.key, pm);
+
+                QTime d(0, 0, 0);
+                d = d.addSecs(job.key.second);
+                qDebug() << "thumb for " << job.key.first << d.toString("hh:mm:ss");
+            }
+        }
+        current = nullptr;
+
+        {
+            QMutexLocker lock(&_queueLock);
+            _inflight.remove(job.key);
+            if (job.grid) _gridBusy = false;
+        }
+        if (!abandoned) emit thumbGenerated(job.key.first, job.key.second);
+    }
+}
+
+}
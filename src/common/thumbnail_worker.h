@@ -31,12 +31,19 @@
 #define _DMR_THUMBNAIL_WORKER_H 
 
 #include <QtWidgets>
-#include <libffmpegthumbnailer/videothumbnailer.h>
+#include <memory>
 
 namespace dmr {
-using namespace ffmpegthumbnailer;
+class FrameDecoder;
+class PackedCache;
 
-class ThumbnailWorker: public QThread {
+// Generates seek bar previews on a small pool of threads. Each of them
+// keeps the file being previewed open and just seeks within it.
+//
+// Besides previews for where the cursor is, every file gets a storyboard:
+// evenly spaced frames packed into one image, which is saved to disk keyed
+// by the identity of the file, so that it is decoded only once.
+class ThumbnailWorker: public QObject {
     Q_OBJECT
 public:
     static ThumbnailWorker& get();
@@ -46,25 +53,102 @@ public:
 
     bool isThumbGenerated(const QUrl& url, int secs);
     QPixmap getThumb(const QUrl& url, int secs);
+    // closest preview already made within half a storyboard step, to show
+    // while the exact one is decoded. secs is updated to where it was taken.
+    QPixmap nearestThumb(const QUrl& url, int *secs);
 
-    void stop() { _quit.store(1); quit(); }
+    // in fast preview mode positions are snapped to the nearest keyframe
+    // close by, so only that frame is decoded and nearby positions share
+    // it. on by default, works once the file is in KeyframeIndex
+    void setFastPreview(bool on) { _fast.store(on); }
+    bool fastPreview() const { return _fast.load(); }
+    // where the preview of secs is taken from
+    int previewPosition(const QUrl& url, int secs) const;
+
+    // maps the saved storyboard of url, or starts building it when nothing
+    // else is asked for
+    void loadStoryboard(const QUrl& url, int duration);
+
+    void stop();
+
+    // previews are kept in a lru store keyed by (url, secs), bounded by a
+    // budget in bytes
+    int cacheBudget() const;
+    void setCacheBudget(int bytes);
+
+    struct Stats {
+        int hits;       // a preview was found
+        int misses;
+        int evictions;  // dropped to stay in budget
+        int count;
+        int bytes;
+    };
+    Stats stats() const;
 
 public slots:
     void requestThumb(const QUrl& url, int secs);
+    // drops previews of any other file
+    void setPlayingUrl(const QUrl& url);
+    // grid and predicted positions wait while set, e.g when playback is
+    // dropping frames
+    void setPrefetchPaused(bool paused);
 
 signals:
     void thumbGenerated(const QUrl& url, int secs);
 
 private:
-    QList<QPair<QUrl, int>> _wq;
-    QHash<QUrl, QMap<int, QPixmap>> _cache;
-    VideoThumbnailer thumber;
+    friend class ThumbThread;
+
+    using ThumbKey = QPair<QUrl, int>;
+    struct Request;
+    struct Job;
+    struct Entry;
+    struct Storyboard;
+    struct Snapshot;
+
+    // newest hover request, replaced without locking. anything older is
+    // abandoned, even while being decoded
+    QAtomicPointer<Request> _mailbox;
+    QAtomicInt _generation {0};
+
+    // below the mailbox, guarded by the queue lock
+    QList<ThumbKey> _ahead;     // extrapolated from hover movement
+    QList<ThumbKey> _grid;      // storyboard positions still missing
+    QHash<ThumbKey, Job*> _inflight;
+    bool _prefetchPaused {false};
+    bool _gridBusy {false};
+
+    // what the gui reads, replaced as a whole under the write lock, so
+    // readers never wait for workers
+    std::shared_ptr<const Snapshot> _snap;
+    PackedCache *_pack {nullptr};
+    int _budget {0};
+
+    // gui thread only
+    QElapsedTimer _hoverClock;
+    int _lastHover {-1};
+
+    QList<QThread*> _workers;
     QAtomicInt _quit{0};
-    qint64 _cacheSize {0};
+    QAtomicInt _fast{1};
+    qreal _dpr {1.0};
+    QAtomicInt _hits {0};
+    QAtomicInt _misses {0};
+    QAtomicInt _evictions {0};
 
     ThumbnailWorker();
-    void run() override;
-    QPixmap genThumb(const QUrl& url, int secs);
+    void work();
+    bool takeWork(Job& job);
+    QList<ThumbKey> predict(const QUrl& url, int secs);
+    std::shared_ptr<const Snapshot> snapshot() const;
+    void publish(Snapshot *s);
+    void insertThumb(const ThumbKey& key, const QPixmap& pm);
+    void evict(Snapshot& s, int budget);
+    QImage genImage(FrameDecoder& decoder, const QUrl& url, int secs);
+    QPixmap genThumb(FrameDecoder& decoder, const QUrl& url, int secs);
+    QImage mapSheet(const Storyboard& b) const;
+    void addTile(const QUrl& url, int secs, const QImage& img);
+    void saveStoryboard();
 };
 
 }
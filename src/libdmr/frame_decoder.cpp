@@ -0,0 +1,306 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "frame_decoder.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libswscale/swscale.h>
+}
+
+#include "libav_compat.h"
+
+namespace dmr {
+
+FrameDecoder::FrameDecoder()
+{
+}
+
+FrameDecoder::~FrameDecoder()
+{
+    close();
+}
+
+int FrameDecoder::checkInterrupt(void *opaque)
+{
+    auto *d = (FrameDecoder*)opaque;
+    if (!d->interrupted()) return 0;
+
+    // whatever libav was reading when it gave up is in an unknown state
+    d->_ioInterrupted = true;
+    return 1;
+}
+
+bool FrameDecoder::open(const QString& file)
+{
+    close();
+
+    _fmt = avformat_alloc_context();
+    if (!_fmt) return false;
+    _fmt->interrupt_callback.callback = &FrameDecoder::checkInterrupt;
+    _fmt->interrupt_callback.opaque = this;
+
+    auto path = file.toUtf8();
+    if (avformat_open_input(&_fmt, path.constData(), NULL, NULL) < 0) {
+        if (!_ioInterrupted)
+            qWarning() << "FrameDecoder: could not open" << file;
+        close();
+        return false;
+    }
+
+    if (!openStream()) {
+        close();
+        return false;
+    }
+
+    _file = file;
+    return true;
+}
+
+bool FrameDecoder::openStream()
+{
+    if (avformat_find_stream_info(_fmt, NULL) < 0) {
+        qWarning() << "FrameDecoder: av_find_stream_info failed";
+        return false;
+    }
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 59
+    const AVCodec *codec = NULL;
+#else
+    AVCodec *codec = NULL;
+#endif
+    _stream = av_find_best_stream(_fmt, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (_stream < 0 || !codec) {
+        qWarning() << "FrameDecoder: no decodable video stream";
+        return false;
+    }
+
+    auto *st = _fmt->streams[_stream];
+    _dec = avcodec_alloc_context3(codec);
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+    if (!_dec || avcodec_parameters_to_context(_dec, st->codecpar) < 0)
+        return false;
+#else
+    if (!_dec || avcodec_copy_context(_dec, st->codec) < 0)
+        return false;
+#endif
+    // slice threads only, frame threads would delay the first frame out
+    _dec->thread_count = 0;
+    _dec->thread_type = FF_THREAD_SLICE;
+    if (avcodec_open2(_dec, codec, NULL) < 0) {
+        qWarning() << "FrameDecoder: could not open decoder";
+        return false;
+    }
+
+    // other streams are never read into packets
+    for (unsigned i = 0; i < _fmt->nb_streams; i++) {
+        if ((int)i != _stream) _fmt->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    auto *tag = av_dict_get(st->metadata, "rotate", NULL, 0);
+    _rotate = tag ? (QString(tag->value).toInt() % 360 + 360) % 360 : 0;
+
+    _frame = av_frame_alloc();
+    _last = av_frame_alloc();
+    _pkt = av_packet_alloc();
+    return _frame && _last && _pkt;
+}
+
+void FrameDecoder::close()
+{
+    sws_freeContext(_sws);
+    _sws = nullptr;
+    av_packet_free(&_pkt);
+    av_frame_free(&_frame);
+    av_frame_free(&_last);
+    avcodec_free_context(&_dec);
+    avformat_close_input(&_fmt);
+    _stream = -1;
+    _rotate = 0;
+    _ioInterrupted = false;
+    _file.clear();
+}
+
+qint64 FrameDecoder::duration() const
+{
+    if (!_fmt || _fmt->duration == AV_NOPTS_VALUE) return 0;
+    return _fmt->duration / (AV_TIME_BASE / 1000);
+}
+
+QImage FrameDecoder::frameAt(qint64 pos, const QSize& size, Qt::AspectRatioMode mode,
+        qint64 *at)
+{
+    if (!isOpen()) return QImage();
+
+    auto *st = _fmt->streams[_stream];
+    auto ts = av_rescale_q(pos, AVRational {1, 1000}, st->time_base);
+    if (st->start_time != AV_NOPTS_VALUE) ts += st->start_time;
+
+    // land on the keyframe before, and decode forward from there
+    if (av_seek_frame(_fmt, _stream, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        if (!_ioInterrupted)
+            qWarning() << "FrameDecoder: seek failed" << pos;
+    } else {
+        avcodec_flush_buffers(_dec);
+        if (decodeUntil(ts)) {
+            if (at) {
+                auto pts = _frame->best_effort_timestamp;
+                if (pts == AV_NOPTS_VALUE) {
+                    *at = pos;
+                } else {
+                    if (st->start_time != AV_NOPTS_VALUE) pts -= st->start_time;
+                    *at = av_rescale_q_rnd(pts, st->time_base, AVRational {1, 1000},
+                            AV_ROUND_DOWN);
+                }
+            }
+            return convert(size, mode);
+        }
+    }
+
+    // interrupted between packets it's fine to seek again next time, but
+    // not within libav io, it's opened again by the next user then
+    if (_ioInterrupted) close();
+    return QImage();
+}
+
+// leaves the first frame at or after ts in _frame, or the last one of the
+// stream if it ends before ts
+bool FrameDecoder::decodeUntil(qint64 ts)
+{
+    av_frame_unref(_last);
+
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
+    bool draining = false;
+
+    while (true) {
+        auto ret = avcodec_receive_frame(_dec, _frame);
+        if (ret == 0) {
+            auto pts = _frame->best_effort_timestamp;
+            if (pts == AV_NOPTS_VALUE || pts >= ts) return true;
+
+            av_frame_unref(_last);
+            av_frame_move_ref(_last, _frame);
+            continue;
+        }
+
+        if (ret != AVERROR(EAGAIN) || draining) {
+            if (!_last->buf[0]) return false;
+            av_frame_move_ref(_frame, _last);
+            return true;
+        }
+
+        if (interrupted()) return false;
+
+        if (av_read_frame(_fmt, _pkt) < 0) {
+            if (_ioInterrupted) return false;
+            avcodec_send_packet(_dec, NULL);
+            draining = true;
+            continue;
+        }
+
+        // broken packets are skipped, the decoder recovers on its own
+        if (_pkt->stream_index == _stream) avcodec_send_packet(_dec, _pkt);
+        av_packet_unref(_pkt);
+    }
+#else
+    while (true) {
+        if (interrupted()) return false;
+
+        // empty packets after the end drain frames still in the decoder
+        bool draining = false;
+        if (av_read_frame(_fmt, _pkt) < 0) {
+            if (_ioInterrupted) return false;
+            av_init_packet(_pkt);
+            _pkt->data = NULL;
+            _pkt->size = 0;
+            _pkt->stream_index = _stream;
+            draining = true;
+        }
+        if (_pkt->stream_index != _stream) {
+            av_packet_unref(_pkt);
+            continue;
+        }
+
+        // broken packets are skipped, the decoder recovers on its own
+        int got = 0;
+        avcodec_decode_video2(_dec, _frame, &got, _pkt);
+        av_packet_unref(_pkt);
+        if (got) {
+            auto pts = av_frame_get_best_effort_timestamp(_frame);
+            if (pts == AV_NOPTS_VALUE || pts >= ts) return true;
+
+            av_frame_unref(_last);
+            av_frame_move_ref(_last, _frame);
+            continue;
+        }
+
+        if (draining) {
+            if (!_last->buf[0]) return false;
+            av_frame_move_ref(_frame, _last);
+            return true;
+        }
+    }
+#endif
+}
+
+QImage FrameDecoder::convert(const QSize& size, Qt::AspectRatioMode mode)
+{
+    QSize display(_frame->width, _frame->height);
+    auto sar = _frame->sample_aspect_ratio;
+    if (sar.num > 0 && sar.den > 0)
+        display.setWidth(display.width() * sar.num / sar.den);
+
+    // scale as it's shown, rotate afterwards
+    bool transposed = _rotate == 90 || _rotate == 270;
+    if (transposed) display.transpose();
+    auto target = size.isEmpty() ? display : display.scaled(size, mode);
+    if (transposed) target.transpose();
+    if (target.isEmpty()) return QImage();
+
+    _sws = sws_getCachedContext(_sws, _frame->width, _frame->height,
+            (AVPixelFormat)_frame->format, target.width(), target.height(),
+            AV_PIX_FMT_RGB32, SWS_AREA, NULL, NULL, NULL);
+    if (!_sws) return QImage();
+
+    // AV_PIX_FMT_RGB32 is native endian argb with opaque alpha, which is
+    // exactly the layout of QImage::Format_RGB32
+    QImage img(target, QImage::Format_RGB32);
+    uint8_t *dst[4] = {img.bits(), NULL, NULL, NULL};
+    int stride[4] = {img.bytesPerLine(), 0, 0, 0};
+    sws_scale(_sws, _frame->data, _frame->linesize, 0, _frame->height, dst, stride);
+
+    if (_rotate) {
+        img = img.transformed(QTransform().rotate(_rotate));
+    }
+    return img;
+}
+
+}
@@ -0,0 +1,98 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_FRAME_DECODER_H
+#define _DMR_FRAME_DECODER_H 
+
+#include <QtGui>
+#include <functional>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+namespace dmr {
+
+/* Keeps demuxer and video decoder of one file open, so frames at arbitrary
+ * positions can be extracted without reopening and reprobing the file each
+ * time. Frames are scaled by swscale straight into a QImage of the size
+ * they are shown at.
+ *
+ * Not thread safe, use one per thread.
+ */
+class FrameDecoder {
+public:
+    FrameDecoder();
+    ~FrameDecoder();
+
+    bool open(const QString& file);
+    void close();
+    bool isOpen() const { return _fmt != nullptr; }
+    const QString& file() const { return _file; }
+    // in msecs, 0 if unknown
+    qint64 duration() const;
+
+    // first frame at or after pos (msecs), scaled into size as mode says,
+    // or in its display size if size is empty. rotation of the stream
+    // applied. null image if nothing was decoded. at is set to where the
+    // frame is, rounded down, so asking for it again gets the same frame
+    QImage frameAt(qint64 pos, const QSize& size, Qt::AspectRatioMode mode = Qt::KeepAspectRatio,
+            qint64 *at = nullptr);
+
+    // polled between packets and by libav while it waits for io. once it
+    // returns true, open() or frameAt() give up and fail
+    using InterruptCallback = std::function<bool()>;
+    void setInterruptCallback(const InterruptCallback& cb) { _interrupt = cb; }
+
+private:
+    InterruptCallback _interrupt;
+    bool _ioInterrupted {false};
+
+    QString _file;
+    AVFormatContext *_fmt {nullptr};
+    AVCodecContext *_dec {nullptr};
+    AVFrame *_frame {nullptr};
+    AVFrame *_last {nullptr};
+    AVPacket *_pkt {nullptr};
+    SwsContext *_sws {nullptr};
+    int _stream {-1};
+    int _rotate {0};
+
+    static int checkInterrupt(void *opaque);
+    bool interrupted() const { return _interrupt && _interrupt(); }
+    bool openStream();
+    bool decodeUntil(qint64 ts);
+    QImage convert(const QSize& size, Qt::AspectRatioMode mode);
+};
+
+}
+
+#endif /* ifndef _DMR_FRAME_DECODER_H */
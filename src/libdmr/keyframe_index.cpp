@@ -0,0 +1,304 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "keyframe_index.h"
+#include "packed_cache.h"
+#include "playlist_journal.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+#include "libav_compat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <QtConcurrent>
+
+#define MAX_INDEX_SIZE (16 << 20)
+#define MAX_INDEX_AGE (90 * 24 * 3600)
+#define MAX_SCAN_BYTES (64 << 20)
+#define MAX_SCAN_MSECS 10000
+
+namespace dmr {
+static std::atomic<KeyframeIndex*> _instance { nullptr };
+static QMutex _instLock;
+
+static QByteArray indexKey(const FileIdentity& id)
+{
+    return QByteArray(1, 'k') + QByteArray((const char*)&id, sizeof id);
+}
+
+// a scan stops when canceled. one without container index to go by is
+// given up after MAX_SCAN_BYTES or MAX_SCAN_MSECS, big files would take
+// minutes to read through
+struct ScanBudget {
+    std::function<bool()> canceled;
+    QElapsedTimer clock;
+    bool overrun {false};
+
+    bool exhausted(AVFormatContext *fmt)
+    {
+        if (clock.elapsed() > MAX_SCAN_MSECS
+                || (fmt && fmt->pb && avio_tell(fmt->pb) > MAX_SCAN_BYTES))
+            overrun = true;
+        return overrun;
+    }
+};
+
+static int scanInterrupted(void *opaque)
+{
+    auto *b = (ScanBudget*)opaque;
+    return b->canceled() || b->exhausted(nullptr);
+}
+
+// false if canceled. a file over budget gets an empty index
+static bool scanKeyframes(const QString& file, ScanBudget& budget, QVector<qint64>& kfs)
+{
+    AVFormatContext *fmt = avformat_alloc_context();
+    if (!fmt) return false;
+    fmt->interrupt_callback.callback = scanInterrupted;
+    fmt->interrupt_callback.opaque = &budget;
+
+    if (avformat_open_input(&fmt, file.toUtf8().constData(), NULL, NULL) < 0) {
+        return !budget.canceled();
+    }
+
+    auto stream = -1;
+    if (avformat_find_stream_info(fmt, NULL) >= 0)
+        stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (stream < 0) {
+        avformat_close_input(&fmt);
+        return !budget.canceled();
+    }
+
+    auto *st = fmt->streams[stream];
+    auto toMsecs = [=](int64_t ts) {
+        if (st->start_time != AV_NOPTS_VALUE) ts -= st->start_time;
+        return (qint64)av_rescale_q(ts, st->time_base, AVRational {1, 1000});
+    };
+
+    // mp4, avi and matroska with cues come with one
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    auto n = avformat_index_get_entries_count(st);
+    for (int i = 0; i < n; i++) {
+        auto *e = avformat_index_get_entry(st, i);
+#else
+    auto n = st->nb_index_entries;
+    for (int i = 0; i < n; i++) {
+        auto *e = &st->index_entries[i];
+#endif
+        if (e->flags & AVINDEX_KEYFRAME) kfs.append(toMsecs(e->timestamp));
+    }
+
+    if (kfs.size() < 2) {
+        kfs.clear();
+        for (unsigned i = 0; i < fmt->nb_streams; i++) {
+            if ((int)i != stream) fmt->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        auto *pkt = av_packet_alloc();
+        while (pkt && !budget.exhausted(fmt) && av_read_frame(fmt, pkt) >= 0) {
+            if (pkt->stream_index == stream && (pkt->flags & AV_PKT_FLAG_KEY)) {
+                auto ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+                if (ts != AV_NOPTS_VALUE) kfs.append(toMsecs(ts));
+            }
+            av_packet_unref(pkt);
+        }
+        av_packet_free(&pkt);
+    }
+
+    avformat_close_input(&fmt);
+    if (budget.canceled()) return false;
+
+    // keyframes of the beginning only would snap everything after to the
+    // last of them
+    if (budget.overrun) {
+        qDebug() << "keyframe scan of" << file << "over budget";
+        kfs.clear();
+        return true;
+    }
+
+    std::sort(kfs.begin(), kfs.end());
+    kfs.erase(std::unique(kfs.begin(), kfs.end()), kfs.end());
+    return true;
+}
+
+KeyframeIndex& KeyframeIndex::get()
+{
+    if (_instance == nullptr) {
+        QMutexLocker lock(&_instLock);
+        if (_instance == nullptr) {
+            _instance = new KeyframeIndex;
+        }
+    }
+
+    return *_instance;
+}
+
+KeyframeIndex::KeyframeIndex()
+{
+    auto dir = QString("%1/%2/%3")
+        .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation))
+        .arg(qApp->organizationName())
+        .arg(qApp->applicationName());
+    QDir().mkpath(dir);
+    _pack = new PackedCache(dir + "/keyframes.pack", 4096);
+
+    // one scan at a time, it's only ever wanted for the file being played
+    _pool.setMaxThreadCount(1);
+}
+
+void KeyframeIndex::schedule(const QUrl& url)
+{
+    if (!url.isLocalFile() || contains(url)) return;
+
+    {
+        QMutexLocker lock(&_lock);
+        if (_building.contains(url)) return;
+        _building.insert(url);
+    }
+
+    int gen = _generation.load();
+    QtConcurrent::run(&_pool, [=]() {
+        // never in the way of playback or previews
+        QThread::currentThread()->setPriority(QThread::IdlePriority);
+        build(url, [=]() { return _generation.load() != gen; });
+
+        QMutexLocker lock(&_lock);
+        _building.remove(url);
+    });
+}
+
+void KeyframeIndex::cancelAll()
+{
+    _generation.ref();
+}
+
+// a record is the count followed by the keyframes, both as qint64. values
+// in the pack are 8 byte aligned, so the array is used where it is mapped,
+// for as long as hold is kept
+bool KeyframeIndex::lookup(const QUrl& url, const qint64 **kfs, int *count,
+        std::shared_ptr<const void> *hold) const
+{
+    auto id = fileIdentity(url);
+    if (id.ino == 0) return false;
+
+    auto data = _pack->find(indexKey(id), hold);
+    if (data.size() < (int)sizeof(qint64)) return false;
+
+    auto *p = (const qint64*)data.constData();
+    if (data.size() < (int)sizeof(qint64) * (int)(p[0] + 1)) return false;
+
+    *kfs = p + 1;
+    *count = (int)p[0];
+    return true;
+}
+
+bool KeyframeIndex::build(const QUrl& url, const std::function<bool()>& canceled)
+{
+    if (contains(url)) return true;
+
+    auto id = fileIdentity(url);
+    if (id.ino == 0) return false;
+
+    ScanBudget budget;
+    budget.canceled = canceled;
+    budget.clock.start();
+    QVector<qint64> kfs;
+    if (!scanKeyframes(url.toLocalFile(), budget, kfs)) return false;
+
+    // changed while being read
+    if (fileIdentity(url) != id) return false;
+
+    // an empty one is kept as well, so the file is not read again
+    qint64 count = kfs.size();
+    QByteArray data((const char*)&count, sizeof count);
+    data.append((const char*)kfs.constData(), kfs.size() * sizeof(qint64));
+    auto key = indexKey(id);
+    if (!_pack->insert(key, data)) {
+        // full, make room and try once more
+        _pack->compact(MAX_INDEX_SIZE, MAX_INDEX_AGE);
+        if (!_pack->insert(key, data)) {
+            qWarning() << "failed to save keyframe index of" << url;
+            return false;
+        }
+    }
+
+    qDebug() << "indexed" << kfs.size() << "keyframes of" << url << "in" << budget.clock.elapsed() << "ms";
+    return true;
+}
+
+bool KeyframeIndex::contains(const QUrl& url) const
+{
+    PackedCache::Hold hold;
+    const qint64 *kfs;
+    int n;
+    return lookup(url, &kfs, &n, &hold);
+}
+
+qint64 KeyframeIndex::nearest(const QUrl& url, qint64 pos) const
+{
+    PackedCache::Hold hold;
+    const qint64 *kfs;
+    int n;
+    if (!lookup(url, &kfs, &n, &hold) || n == 0) return -1;
+
+    auto *p = std::lower_bound(kfs, kfs + n, pos);
+    if (p == kfs + n) return kfs[n - 1];
+    if (p == kfs) return *p;
+    return *p - pos < pos - *(p - 1) ? *p : *(p - 1);
+}
+
+qint64 KeyframeIndex::next(const QUrl& url, qint64 pos) const
+{
+    PackedCache::Hold hold;
+    const qint64 *kfs;
+    int n;
+    if (!lookup(url, &kfs, &n, &hold)) return -1;
+
+    auto *p = std::lower_bound(kfs, kfs + n, pos);
+    return p == kfs + n ? -1 : *p;
+}
+
+QVector<qint64> KeyframeIndex::keyframes(const QUrl& url) const
+{
+    QVector<qint64> ret;
+    PackedCache::Hold hold;
+    const qint64 *kfs;
+    int n;
+    if (lookup(url, &kfs, &n, &hold)) {
+        ret.resize(n);
+        std::copy(kfs, kfs + n, ret.begin());
+    }
+    return ret;
+}
+
+}
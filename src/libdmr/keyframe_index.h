@@ -0,0 +1,81 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_KEYFRAME_INDEX_H
+#define _DMR_KEYFRAME_INDEX_H 
+
+#include <QtCore>
+#include <functional>
+#include <memory>
+
+namespace dmr {
+class PackedCache;
+
+/* Where the keyframes of a local file are, in msecs from its start.
+ *
+ * Built once per file from the index of the container, or by reading the
+ * packet headers when it has none, nothing is decoded. Reading is bounded,
+ * files too big to read through in time get an empty index. Kept on disk
+ * keyed by file identity, lookups search the mapped array in place.
+ */
+class KeyframeIndex {
+public:
+    static KeyframeIndex& get();
+
+    // indexes url on a low priority thread of its own, unless it's known
+    // or being indexed already
+    void schedule(const QUrl& url);
+    // scans in progress give up, queued ones are skipped
+    void cancelAll();
+    bool contains(const QUrl& url) const;
+
+    // -1 if url is not indexed, or there is no such keyframe
+    qint64 nearest(const QUrl& url, qint64 pos) const;
+    // first keyframe at or after pos
+    qint64 next(const QUrl& url, qint64 pos) const;
+
+    QVector<qint64> keyframes(const QUrl& url) const;
+
+private:
+    PackedCache *_pack {nullptr};
+    QThreadPool _pool;
+    QMutex _lock;
+    QSet<QUrl> _building;
+    QAtomicInt _generation {0};
+
+    KeyframeIndex();
+    bool build(const QUrl& url, const std::function<bool()>& canceled);
+    // hold is a PackedCache::Hold
+    bool lookup(const QUrl& url, const qint64 **kfs, int *count,
+            std::shared_ptr<const void> *hold) const;
+};
+
+}
+
+#endif /* ifndef _DMR_KEYFRAME_INDEX_H */
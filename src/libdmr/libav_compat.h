@@ -0,0 +1,61 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_LIBAV_COMPAT_H
+#define _DMR_LIBAV_COMPAT_H 
+
+// packet helpers of newer libav, for building against older ones
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/mem.h>
+}
+
+// older libav has neither heap allocated packets nor av_packet_unref
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 8, 100)
+#define av_packet_unref av_free_packet
+#endif
+
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 12, 100)
+static inline AVPacket *av_packet_alloc()
+{
+    auto *pkt = (AVPacket*)av_mallocz(sizeof(AVPacket));
+    if (pkt) av_init_packet(pkt);
+    return pkt;
+}
+
+static inline void av_packet_free(AVPacket **pkt)
+{
+    if (!*pkt) return;
+    av_packet_unref(*pkt);
+    av_freep(pkt);
+}
+#endif
+
+#endif /* ifndef _DMR_LIBAV_COMPAT_H */
@@ -0,0 +1,479 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "packed_cache.h"
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace dmr {
+
+static const char kMagic[4] = {'D', 'M', 'R', 'C'};
+static const quint32 kVersion = 4;
+static const quint64 kIndexStart = 64;
+// the file is mapped once at this size, so it never needs a remap and
+// pointers handed out by find() stay valid; growth beyond it is refused
+static const quint64 kMaxFileSize = (sizeof(void*) == 8 ? 1ULL << 30 : 1ULL << 27);
+
+struct PackedCache::Header {
+    char magic[4];
+    quint32 version;
+    quint32 capacity;
+    quint32 count;
+    quint32 retired;
+};
+
+struct PackedCache::Slot {
+    quint64 hash; // 0 marks a free slot
+    quint64 offset;
+};
+
+static inline quint64 align8(quint64 v) { return (v + 7) & ~7ULL; }
+
+// record: quint32 key size | quint32 value size | quint64 used | key | value,
+// records and values are 8 bytes aligned, so values can be used in place.
+// used is when the record was written or last found, in secs
+struct RecordHeader {
+    quint32 keySize;
+    quint32 valueSize;
+    quint64 used;
+
+    quint64 valueOffset() const { return align8(sizeof(RecordHeader) + keySize); }
+    quint64 length() const { return valueOffset() + valueSize; }
+};
+
+struct PackedCache::Mapping {
+    int fd;
+    uchar *base;
+    quint32 capacity;
+    // file size as last seen. files only ever grow in place, so it's a
+    // lower bound of the real one
+    mutable quint64 size;
+
+    Header *header() const { return (Header*)base; }
+    Slot *slots() const { return (Slot*)(base + kIndexStart); }
+    quint64 dataStart() const { return kIndexStart + (quint64)capacity * sizeof(Slot); }
+    const RecordHeader *record(quint64 off) const { return (const RecordHeader*)(base + off); }
+
+    // pages of the mapping past the end of file raise SIGBUS when touched
+    bool backed(quint64 end) const {
+        if (end > kMaxFileSize) return false;
+        if (end <= __atomic_load_n(&size, __ATOMIC_RELAXED)) return true;
+        struct stat st;
+        if (::fstat(fd, &st) != 0) return false;
+        __atomic_store_n(&size, (quint64)st.st_size, __ATOMIC_RELAXED);
+        return end <= (quint64)st.st_size;
+    }
+
+    // slots may be torn or stale, never trust an offset read from them
+    bool validRecord(quint64 off) const {
+        return off >= dataStart() && off < kMaxFileSize && off % 8 == 0 &&
+            backed(off + sizeof(RecordHeader)) && backed(off + record(off)->length());
+    }
+
+    bool recordMatches(quint64 off, const QByteArray& key) const {
+        if (!validRecord(off)) return false;
+        auto *r = record(off);
+        return r->keySize == (quint32)key.size() &&
+            memcmp(base + off + sizeof(RecordHeader), key.constData(), key.size()) == 0;
+    }
+};
+
+// found records are touched at most this often, so hits don't keep
+// dirtying pages of the shared mapping
+static const quint64 kTouchInterval = 3600;
+
+static inline quint64 now()
+{
+    return (quint64)QDateTime::currentMSecsSinceEpoch() / 1000;
+}
+
+static inline quint64 keyHash(const QByteArray& key)
+{
+    // FNV-1a, stable across processes unlike qHash
+    quint64 h = 14695981039346656037ULL;
+    for (char c: key) {
+        h ^= (uchar)c;
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+
+template <class T>
+static inline T loadAcquire(const T *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+template <class T>
+static inline void storeRelease(T *p, T v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+class FileLocker {
+public:
+    FileLocker(int fd): _fd(fd) { ::flock(_fd, LOCK_EX); }
+    ~FileLocker() { unlock(); }
+    void unlock() {
+        if (_fd >= 0) ::flock(_fd, LOCK_UN);
+        _fd = -1;
+    }
+private:
+    int _fd;
+};
+
+PackedCache::PackedCache(const QString& path, quint32 capacity)
+    :_path(path)
+{
+    quint32 n = 16;
+    while (n < capacity) n <<= 1;
+    _capacity = n;
+
+    std::atomic_store(&_map, openMapping());
+}
+
+void PackedCache::releaseHold(void *hold)
+{
+    delete static_cast<Hold*>(hold);
+}
+
+// open and map the file at _path, creating it when missing or unusable.
+// the first instance initializes it, others pick up the existing capacity
+std::shared_ptr<PackedCache::Mapping> PackedCache::openMapping() const
+{
+    auto fn = QFile::encodeName(_path);
+    for (int tries = 0; tries < 4; tries++) {
+        int fd = ::open(fn.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            qWarning() << "open cache failed" << _path << strerror(errno);
+            return nullptr;
+        }
+
+        ::flock(fd, LOCK_EX);
+        // the file may have been replaced meanwhile by another instance
+        struct stat st, pst;
+        if (::fstat(fd, &st) != 0 || ::stat(fn.constData(), &pst) != 0 ||
+                st.st_dev != pst.st_dev || st.st_ino != pst.st_ino) {
+            ::flock(fd, LOCK_UN);
+            ::close(fd);
+            continue;
+        }
+
+        Header h;
+        bool ok = ::pread(fd, &h, sizeof h, 0) == sizeof h &&
+            memcmp(h.magic, kMagic, sizeof kMagic) == 0 && h.version == kVersion &&
+            !h.retired && h.capacity && (h.capacity & (h.capacity - 1)) == 0 &&
+            (quint64)st.st_size >= kIndexStart + (quint64)h.capacity * sizeof(Slot);
+
+        if (!ok && st.st_size > 0) {
+            // unknown or broken, instances still using it keep their mapping
+            qWarning() << "drop invalid cache file" << _path;
+            ::unlink(fn.constData());
+            ::flock(fd, LOCK_UN);
+            ::close(fd);
+            continue;
+        }
+
+        if (!ok) {
+            memset(&h, 0, sizeof h);
+            memcpy(h.magic, kMagic, sizeof kMagic);
+            h.version = kVersion;
+            h.capacity = _capacity;
+            // the index is a sparse hole until slots get written
+            if (::ftruncate(fd, kIndexStart + (quint64)h.capacity * sizeof(Slot)) != 0 ||
+                    ::pwrite(fd, &h, sizeof h, 0) != sizeof h) {
+                qWarning() << "init cache failed" << _path << strerror(errno);
+                ::flock(fd, LOCK_UN);
+                ::close(fd);
+                return nullptr;
+            }
+        }
+
+        void *p = ::mmap(nullptr, kMaxFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::flock(fd, LOCK_UN);
+        if (p == MAP_FAILED) {
+            qWarning() << "mmap cache failed" << _path << strerror(errno);
+            ::close(fd);
+            return nullptr;
+        }
+
+        quint64 size = ok ? st.st_size : kIndexStart + (quint64)h.capacity * sizeof(Slot);
+        return std::shared_ptr<Mapping>(new Mapping {fd, (uchar*)p, h.capacity, size}, [](Mapping *m) {
+            ::munmap(m->base, kMaxFileSize);
+            ::close(m->fd);
+            delete m;
+        });
+    }
+
+    return nullptr;
+}
+
+// called with _writeLock held. the old mapping goes away with whoever
+// still holds it last
+void PackedCache::switchMapping() const
+{
+    auto m = openMapping();
+    if (!m) return;
+    std::atomic_store(&_map, m);
+}
+
+std::shared_ptr<PackedCache::Mapping> PackedCache::current() const
+{
+    auto m = std::atomic_load(&_map);
+    if (m && loadAcquire(&m->header()->retired)) {
+        QMutexLocker lock(&_writeLock);
+        if (std::atomic_load(&_map) == m) switchMapping();
+        m = std::atomic_load(&_map);
+    }
+    return m;
+}
+
+quint64 PackedCache::findRecord(const Mapping *m, const QByteArray& key) const
+{
+    if (!m) return 0;
+
+    auto h = keyHash(key);
+    auto mask = m->capacity - 1;
+    Slot *s = m->slots();
+    for (quint32 i = h & mask, n = 0; n < m->capacity; i = (i + 1) & mask, n++) {
+        auto sh = loadAcquire(&s[i].hash);
+        if (sh == 0) break;
+        if (sh == h) {
+            auto off = loadAcquire(&s[i].offset);
+            if (m->recordMatches(off, key)) return off;
+        }
+    }
+
+    return 0;
+}
+
+bool PackedCache::contains(const QByteArray& key) const
+{
+    return findRecord(current().get(), key) != 0;
+}
+
+QByteArray PackedCache::find(const QByteArray& key, Hold *hold) const
+{
+    auto m = current();
+    auto off = findRecord(m.get(), key);
+    if (!off) return QByteArray();
+
+    auto *r = m->record(off);
+    auto t = now();
+    if (__atomic_load_n(&r->used, __ATOMIC_RELAXED) + kTouchInterval < t) {
+        // racing writers of it store about the same time
+        __atomic_store_n(&((RecordHeader*)r)->used, t, __ATOMIC_RELAXED);
+    }
+
+    auto *data = (const char*)r + r->valueOffset();
+    if (!hold) return QByteArray(data, r->valueSize);
+
+    *hold = m;
+    return QByteArray::fromRawData(data, r->valueSize);
+}
+
+// called with the file locked
+bool PackedCache::append(Mapping *m, const QByteArray& key, const QByteArray& value)
+{
+    // another instance may have appended since, always look at the real end
+    struct stat st;
+    if (::fstat(m->fd, &st) != 0) return false;
+    quint64 off = align8(st.st_size);
+    RecordHeader rh {(quint32)key.size(), (quint32)value.size(), now()};
+    quint64 len = rh.length();
+    if (off + len > kMaxFileSize) {
+        qWarning() << "cache file is full";
+        return false;
+    }
+
+    auto h = keyHash(key);
+    auto mask = m->capacity - 1;
+    Slot *s = m->slots();
+    Slot *target = nullptr;
+    for (quint32 i = h & mask, n = 0; n < m->capacity; i = (i + 1) & mask, n++) {
+        auto sh = s[i].hash;
+        if (sh == 0 || (sh == h && m->recordMatches(s[i].offset, key))) {
+            target = &s[i];
+            break;
+        }
+    }
+
+    bool fresh = target && target->hash == 0;
+    // keep the load factor of the probing table under 3/4
+    if (!target || (fresh && m->header()->count >= m->capacity / 4 * 3)) {
+        qWarning() << "cache index is full";
+        return false;
+    }
+
+    QByteArray rec(len, 0);
+    memcpy(rec.data(), &rh, sizeof rh);
+    memcpy(rec.data() + sizeof rh, key.constData(), key.size());
+    memcpy(rec.data() + rh.valueOffset(), value.constData(), value.size());
+    if (::pwrite(m->fd, rec.constData(), rec.size(), off) != rec.size())
+        return false;
+
+    // publish the record only after it's completely written, readers
+    // take the hash first and then the offset
+    storeRelease(&target->offset, off);
+    if (fresh) {
+        storeRelease(&target->hash, h);
+        m->header()->count++;
+    }
+    return true;
+}
+
+bool PackedCache::insert(const QByteArray& key, const QByteArray& value)
+{
+    if (key.isEmpty()) return false;
+
+    QMutexLocker lock(&_writeLock);
+    for (int tries = 0; tries < 2; tries++) {
+        auto m = std::atomic_load(&_map);
+        if (!m) return false;
+
+        FileLocker fl(m->fd);
+        if (m->header()->retired) {
+            // compacted by another instance, the record goes to the new file
+            fl.unlock();
+            switchMapping();
+            continue;
+        }
+        return append(m.get(), key, value);
+    }
+
+    return false;
+}
+
+int PackedCache::compact(qint64 maxBytes, qint64 maxAge)
+{
+    QMutexLocker lock(&_writeLock);
+    auto m = std::atomic_load(&_map);
+    if (!m) return -1;
+
+    FileLocker fl(m->fd);
+    if (m->header()->retired) {
+        // someone else just did it
+        fl.unlock();
+        switchMapping();
+        return 0;
+    }
+
+    struct Live {
+        quint64 hash;
+        quint64 offset;
+        quint64 length;
+        quint64 used;
+    };
+    QVector<Live> live;
+    auto t = now();
+    int dropped = 0;
+    Slot *s = m->slots();
+    for (quint32 i = 0; i < m->capacity; i++) {
+        if (!s[i].hash) continue;
+        if (!m->validRecord(s[i].offset)) {
+            dropped++;
+            continue;
+        }
+        auto *r = m->record(s[i].offset);
+        if (r->used + maxAge < t) {
+            dropped++;
+            continue;
+        }
+        live.append({s[i].hash, s[i].offset,
+                r->length(), r->used});
+    }
+
+    // most recently used first, cut off at the size budget. and at half of
+    // the index, or a full one of fresh records could never make room
+    std::sort(live.begin(), live.end(), [](const Live& a, const Live& b) {
+        return a.used > b.used;
+    });
+    quint64 total = m->dataStart();
+    int keep = 0;
+    int maxCount = m->capacity / 2;
+    while (keep < live.size() && keep < maxCount &&
+            total + align8(live[keep].length) <= (quint64)maxBytes) {
+        total += align8(live[keep].length);
+        keep++;
+    }
+    dropped += live.size() - keep;
+    live.resize(keep);
+
+    auto tmpPath = QFile::encodeName(_path + ".gc");
+    int fd = ::open(tmpPath.constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        qWarning() << "gc cache failed" << strerror(errno);
+        return -1;
+    }
+
+    QVector<Slot> index(m->capacity, Slot {0, 0});
+    auto mask = m->capacity - 1;
+    quint64 off = m->dataStart();
+    bool ok = ::ftruncate(fd, off) == 0;
+    for (int i = 0; ok && i < live.size(); i++) {
+        const auto& l = live[i];
+        ok = ::pwrite(fd, m->base + l.offset, l.length, off) == (ssize_t)l.length;
+
+        auto j = l.hash & mask;
+        while (index[j].hash) j = (j + 1) & mask;
+        index[j] = {l.hash, off};
+        off = align8(off + l.length);
+    }
+
+    Header h = *m->header();
+    h.count = live.size();
+    h.retired = 0;
+    ok = ok && ::pwrite(fd, index.constData(), index.size() * sizeof(Slot), kIndexStart) ==
+        (ssize_t)(index.size() * sizeof(Slot));
+    ok = ok && ::pwrite(fd, &h, sizeof h, 0) == sizeof h;
+    ok = ok && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || ::rename(tmpPath.constData(), QFile::encodeName(_path).constData()) != 0) {
+        qWarning() << "gc cache failed" << strerror(errno);
+        ::unlink(tmpPath.constData());
+        return -1;
+    }
+
+    storeRelease(&m->header()->retired, 1u);
+    fl.unlock();
+    switchMapping();
+    return dropped;
+}
+
+qint64 PackedCache::fileSize() const
+{
+    auto m = current();
+    struct stat st;
+    if (!m || ::fstat(m->fd, &st) != 0) return 0;
+    return st.st_size;
+}
+
+}
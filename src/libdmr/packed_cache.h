@@ -0,0 +1,101 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_PACKED_CACHE_H
+#define _DMR_PACKED_CACHE_H 
+
+#include <QtCore>
+#include <memory>
+
+namespace dmr {
+
+/* An append-only key/value store kept in a single file, shared by all
+ * running instances.
+ *
+ * layout: header | index (open addressing, fixed capacity) | records ...
+ *
+ * Records are never modified in place, writing a key again appends a new
+ * record and repoints its index slot. The whole file is mapped shared, so
+ * lookups are lock-free and values are served straight from the mapping.
+ * Writers serialize with a mutex (threads) and flock (processes).
+ *
+ * compact() writes the live records into a new file and renames it over
+ * the old one, which is then marked retired. Every instance switches to
+ * the new file on its next access. A retired mapping is unmapped once the
+ * last Hold on it is gone.
+ */
+class PackedCache {
+public:
+    // keeps the mapping a value was found in
+    using Hold = std::shared_ptr<const void>;
+    // QImageCleanupFunction for a Hold allocated with new
+    static void releaseHold(void *hold);
+
+    PackedCache(const QString& path, quint32 capacity = 1 << 16);
+
+    bool isValid() const { return std::atomic_load(&_map) != nullptr; }
+
+    // empty if key is not found. without hold the value is copied out,
+    // with it the data points into the mapping and stays valid as long as
+    // *hold is kept
+    QByteArray find(const QByteArray& key, Hold *hold = nullptr) const;
+    bool contains(const QByteArray& key) const;
+
+    // fails when the index or the file is full
+    bool insert(const QByteArray& key, const QByteArray& value);
+
+    // drop records not used for maxAge secs, then the least recently used
+    // ones until the file fits into maxBytes and the index is at most half
+    // full. a record is used when it's written or found. returns number of
+    // records dropped, or -1
+    int compact(qint64 maxBytes, qint64 maxAge);
+
+    qint64 fileSize() const;
+
+private:
+    struct Header;
+    struct Slot;
+    struct Mapping;
+
+    QString _path;
+    quint32 _capacity;
+    // read and replaced with std::atomic_load/store
+    mutable std::shared_ptr<Mapping> _map;
+    mutable QMutex _writeLock;
+
+    std::shared_ptr<Mapping> current() const;
+    std::shared_ptr<Mapping> openMapping() const;
+    void switchMapping() const;
+    quint64 findRecord(const Mapping *m, const QByteArray& key) const;
+    bool append(Mapping *m, const QByteArray& key, const QByteArray& value);
+};
+
+}
+
+#endif /* ifndef _DMR_PACKED_CACHE_H */
@@ -115,7 +115,9 @@ public:
     virtual void setVideoRotation(int degree) = 0;
 
     virtual QImage takeScreenshot() = 0;
-    virtual void burstScreenshot() = 0; //initial the start of burst screenshotting
+    //initial the start of burst screenshotting, frames are scaled to size
+    //if backend can, full sized if it's empty
+    virtual void burstScreenshot(const QSize& size = QSize()) = 0;
     virtual void stopBurstScreenshot() = 0;
 
     // hack: used to access backend internal states
@@ -132,11 +134,14 @@ Q_SIGNALS:
     void elapsedChanged();
     void videoSizeChanged();
     void stateChanged();
-    void fileLoaded();
+    // url is what was loaded, the playlist may have moved on since
+    void fileLoaded(const QUrl& url);
     void muteChanged();
     void volumeChanged();
     void sidChanged();
     void aidChanged();
+    // playback could not keep up and skipped frames
+    void framesDropped();
 
     //emit during burst screenshotting
     void notifyScreenshot(const QImage& frame, qint64 time);
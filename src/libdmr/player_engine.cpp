@@ -33,6 +33,7 @@
 #include "playlist_model.h"
 #include "movie_configuration.h"
 #include "online_sub.h"
+#include "keyframe_index.h"
 
 #include "mpv_proxy.h"
 
@@ -57,11 +58,14 @@ PlayerEngine::PlayerEngine(QWidget *parent)
         connect(_current, &Backend::tracksChanged, this, &PlayerEngine::tracksChanged);
         connect(_current, &Backend::elapsedChanged, this, &PlayerEngine::elapsedChanged);
         connect(_current, &Backend::fileLoaded, this, &PlayerEngine::fileLoaded);
+        // the switch went straight into the next file without being idle
+        connect(_current, &Backend::fileLoaded, [=]() { _endRequested = false; });
         connect(_current, &Backend::muteChanged, this, &PlayerEngine::muteChanged);
         connect(_current, &Backend::volumeChanged, this, &PlayerEngine::volumeChanged);
         connect(_current, &Backend::sidChanged, this, &PlayerEngine::sidChanged);
         connect(_current, &Backend::aidChanged, this, &PlayerEngine::aidChanged);
         connect(_current, &Backend::videoSizeChanged, this, &PlayerEngine::videoSizeChanged);
+        connect(_current, &Backend::framesDropped, this, &PlayerEngine::framesDropped);
         connect(_current, &Backend::notifyScreenshot, this, &PlayerEngine::notifyScreenshot);
         l->addWidget(_current);
     }
@@ -77,12 +81,29 @@ PlayerEngine::PlayerEngine(QWidget *parent)
     addSubSearchPath(OnlineSubtitle::get().storeLocation());
 
     _playlist = new PlaylistModel(this);
-    connect(_playlist, &PlaylistModel::asyncAppendFinished, this, 
-            &PlayerEngine::onPlaylistAsyncAppendFinished);
+    // every async appended item is reported by a progress batch, so a pending
+    // play request can be served before the whole job is done
+    connect(_playlist, &PlaylistModel::asyncAppendProgress, this, 
+            &PlayerEngine::onPlaylistAsyncAppendProgress);
+
+    // what comes next is opened ahead of time
+    if (auto *mpv = dynamic_cast<MpvProxy*>(_current)) {
+        connect(mpv, &MpvProxy::advanced, this, &PlayerEngine::onBackendAdvanced);
+        connect(this, &PlayerEngine::fileLoaded, this, &PlayerEngine::updatePreload);
+        connect(_playlist, &PlaylistModel::countChanged, this, &PlayerEngine::updatePreload);
+        connect(_playlist, &PlaylistModel::currentChanged, this, &PlayerEngine::updatePreload);
+        connect(_playlist, &PlaylistModel::playModeChanged, this, &PlayerEngine::updatePreload);
+    }
+
+    // for previews and seeking, files indexed before are not read again
+    connect(this, &PlayerEngine::fileLoaded, [=](const QUrl& url) {
+        KeyframeIndex::get().schedule(url);
+    });
 }
 
 PlayerEngine::~PlayerEngine()
 {
+    KeyframeIndex::get().cancelAll();
     disconnect(_playlist, 0, 0, 0);
     delete _playlist;
     _playlist = nullptr;
@@ -195,13 +216,37 @@ void PlayerEngine::updateSubStyles()
 #endif
 }
 
-void PlayerEngine::waitLastEnd()
+void PlayerEngine::endLastPlayback(int next)
 {
     if (auto *mpv = dynamic_cast<MpvProxy*>(_current)) {
-        mpv->pollingEndOfPlayback();
+        if (_advancedTo.isValid()) return;
+        if (next >= 0 && next < _playlist->count() && mpv->preloaded().isValid()
+                && _playlist->items()[next].url == mpv->preloaded())
+            return;
+
+        if (mpv->state() != Backend::PlayState::Stopped)
+            _endRequested = true;
+        mpv->endPlayback();
     }
 }
 
+void PlayerEngine::updatePreload()
+{
+    auto *mpv = dynamic_cast<MpvProxy*>(_current);
+    if (!mpv || state() == CoreState::Idle) return;
+
+    auto id = _playlist->predictNext();
+    mpv->preload(id >= 0 ? _playlist->items()[id].url : QUrl());
+}
+
+void PlayerEngine::onBackendAdvanced(const QUrl& url)
+{
+    qDebug() << "backend advanced to" << url;
+    _advancedTo = url;
+    _playlist->playNext(false);
+    _advancedTo.clear();
+}
+
 void PlayerEngine::onBackendStateChanged()
 {
     if (!_current) return;
@@ -222,6 +267,10 @@ void PlayerEngine::onBackendStateChanged()
     updateSubStyles();
     if (old != _state)
         emit stateChanged();
+
+    // observers have seen it, what ends next is the movie itself
+    if (_state == CoreState::Idle)
+        _endRequested = false;
 }
 
 PlayerEngine::CoreState PlayerEngine::state()
@@ -450,6 +499,9 @@ void PlayerEngine::requestPlay(int id)
     data.appExec = "deepin-movie";
     DRecentManager::addItem(item.url.toLocalFile(), data);
 
+    // being loaded already
+    if (_advancedTo.isValid() && item.url == _advancedTo) return;
+
     if (_current->isPlayable()) {
         _current->play();
     } else {
@@ -507,7 +559,7 @@ void PlayerEngine::next()
     _playingRequest = false;
 }
 
-void PlayerEngine::onPlaylistAsyncAppendFinished(const QList<PlayItemInfo>& pil)
+void PlayerEngine::onPlaylistAsyncAppendProgress(const QList<PlayItemInfo>& pil)
 {
     if (_pendingPlayReq.isValid()) {
         auto id = _playlist->indexOf(_pendingPlayReq);
@@ -531,6 +583,7 @@ void PlayerEngine::playByName(const QUrl& url)
         _playlist->changeCurrent(id);
     } else {
         _pendingPlayReq = url;
+        _playlist->prioritize(url);
     }
 }
 
@@ -570,9 +623,9 @@ QImage PlayerEngine::takeScreenshot()
     return _current->takeScreenshot();
 }
 
-void PlayerEngine::burstScreenshot()
+void PlayerEngine::burstScreenshot(const QSize& size)
 {
-    _current->burstScreenshot();
+    _current->burstScreenshot(size);
 }
 
 void PlayerEngine::stopBurstScreenshot()
@@ -601,6 +654,12 @@ void PlayerEngine::seekAbsolute(int pos)
     _current->seekAbsolute(pos);
 }
 
+qint64 PlayerEngine::nearestKeyframe(qint64 pos) const
+{
+    if (_playlist->count() == 0) return -1;
+    return KeyframeIndex::get().nearest(_playlist->currentInfo().url, pos);
+}
+
 void PlayerEngine::setDVDDevice(const QString& path)
 {
     if (!_current) { return; }
@@ -693,6 +752,13 @@ QSize PlayerEngine::videoSize() const
     return _current->videoSize();
 }
 
+void PlayerEngine::setElapsedRate(int hz)
+{
+    if (auto *mpv = dynamic_cast<MpvProxy*>(_current)) {
+        mpv->setElapsedRate(hz);
+    }
+}
+
 qint64 PlayerEngine::elapsed() const
 {
     if (!_current) return 0;
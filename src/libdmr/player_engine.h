@@ -73,10 +73,15 @@ public:
     const QStringList subtitle_suffixs {"ass", "sub", "srt", "aqt", "jss", "gsub", "ssf", "ssa", "smi", "usf", "idx"};
 
     /* backend like mpv will asynchronously report end of playback. 
-     * there are situations when we need to see the end-event before 
-     * proceed (e.g playlist next)
+     * this asks for the end without waiting for it: a play request made
+     * meanwhile is issued by the backend once the end is reported, and the
+     * Idle state caused by it is flagged by endRequested(), so it's not
+     * taken as the end of the movie (e.g playlist next).
+     * next is the item to be played right after, if the backend has it
+     * preloaded the current playback is left for it to take over
      */
-    void waitLastEnd();
+    void endLastPlayback(int next = -1);
+    bool endRequested() const { return _endRequested; }
 
     friend class PlaylistModel;
 
@@ -103,7 +108,12 @@ public:
 
     qint64 duration() const;
     qint64 elapsed() const;
+    // elapsedChanged is emitted once the elapsed second changes, at most
+    // hz times a second (4 by default). 0 for every update of the backend
+    void setElapsedRate(int hz);
     QSize videoSize() const;
+    // msecs, -1 until keyframes of the current file are indexed
+    qint64 nearestKeyframe(qint64 pos) const;
     const struct MovieInfo& movieInfo(); 
 
     bool paused();
@@ -134,7 +144,7 @@ public:
     PlaylistModel& playlist() const { return *_playlist; }
 
     QImage takeScreenshot();
-    void burstScreenshot(); //initial the start of burst screenshotting
+    void burstScreenshot(const QSize& size = QSize()); //initial the start of burst screenshotting
     void stopBurstScreenshot();
 
     void savePlaybackPosition();
@@ -151,12 +161,14 @@ signals:
     void elapsedChanged();
     void videoSizeChanged();
     void stateChanged();
-    void fileLoaded();
+    // url is what was loaded, the playlist may have moved on since
+    void fileLoaded(const QUrl& url);
     void muteChanged();
     void volumeChanged();
     void sidChanged();
     void aidChanged();
     void subCodepageChanged();
+    void framesDropped();
 
     void loadOnlineSubtitlesFinished(const QUrl& url, bool success);
 
@@ -191,7 +203,10 @@ protected slots:
     void updateSubStyles();
     void onSubtitlesDownloaded(const QUrl& url, const QList<QString>& filenames,
             OnlineSubtitle::FailReason);
-    void onPlaylistAsyncAppendFinished(const QList<PlayItemInfo>&);
+    void onPlaylistAsyncAppendProgress(const QList<PlayItemInfo>&);
+    // keeps the backend's preloaded file in line with the playlist
+    void updatePreload();
+    void onBackendAdvanced(const QUrl& url);
 
 protected:
     PlaylistModel *_playlist {nullptr};
@@ -201,6 +216,9 @@ protected:
     QUrl _pendingPlayReq;
 
     bool _playingRequest {false};
+    bool _endRequested {false};
+    // the backend went on to it by itself, the playlist is catching up
+    QUrl _advancedTo;
 
     QList<QUrl> collectPlayFiles(const QList<QUrl>& urls);
     QList<QUrl> collectPlayDir(const QDir& dir);
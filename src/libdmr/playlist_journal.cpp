@@ -0,0 +1,355 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "playlist_journal.h"
+
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace dmr {
+
+static const quint32 kJournalMagic = 0x444d5250; // DMRP
+static const quint32 kJournalVersion = 1;
+
+FileIdentity fileIdentity(const QUrl& url)
+{
+    FileIdentity id {0, 0, 0, 0};
+    struct stat st;
+    if (url.isLocalFile() && ::stat(QFile::encodeName(url.toLocalFile()).constData(), &st) == 0) {
+        id.dev = st.st_dev;
+        id.ino = st.st_ino;
+        id.size = st.st_size;
+        id.mtime_ns = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    }
+    return id;
+}
+
+static QDataStream& operator<< (QDataStream& ds, const FileIdentity& id)
+{
+    return ds << id.dev << id.ino << id.size << id.mtime_ns;
+}
+
+static QDataStream& operator>> (QDataStream& ds, FileIdentity& id)
+{
+    return ds >> id.dev >> id.ino >> id.size >> id.mtime_ns;
+}
+
+PlaylistJournal::PlaylistJournal(const QString& path, bool readOnly)
+    :QObject(), _path(path), _readOnly(readOnly), _file(path)
+{
+    if (!_readOnly && !takeOwnership()) {
+        qDebug() << "playlist journal is owned by another instance";
+        _readOnly = true;
+    }
+
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(500);
+    connect(&_flushTimer, &QTimer::timeout, this, &PlaylistJournal::flush);
+}
+
+PlaylistJournal::~PlaylistJournal()
+{
+    flush();
+    _file.close();
+    // the next instance to start takes it over
+    if (_ownerFd >= 0) ::close(_ownerFd);
+}
+
+// the lock is on a file of its own, the journal itself gets replaced by
+// snapshots and is locked for every write
+bool PlaylistJournal::takeOwnership()
+{
+    auto fn = QFile::encodeName(_path + ".owner");
+    int fd = ::open(fn.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        qWarning() << "open playlist journal lock failed" << strerror(errno);
+        return false;
+    }
+
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(fd);
+        return false;
+    }
+    _ownerFd = fd;
+    return true;
+}
+
+QList<PlaylistJournal::Entry> PlaylistJournal::load()
+{
+    QList<Entry> entries;
+
+    // held until the tail is fixed or the snapshot is in place, so no
+    // other instance appends in between
+    bool locked = !_readOnly && lockForWrite();
+
+    QFile f(_path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        if (locked) unlock();
+        return entries;
+    }
+    auto data = f.readAll();
+    f.close();
+
+    QDataStream ds(data);
+    ds.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0, version = 0;
+    ds >> magic >> version;
+    if (ds.status() != QDataStream::Ok || magic != kJournalMagic || version != kJournalVersion) {
+        qWarning() << "invalid playlist journal" << _path;
+        if (locked) writeSnapshot(entries);
+        return entries;
+    }
+
+    // rows shift on remove and move, index is rebuilt lazily then
+    QHash<QUrl, int> index;
+    bool dirty = false;
+    auto rowOf = [&](const QUrl& url) {
+        if (dirty) {
+            index.clear();
+            for (int i = 0; i < entries.size(); i++) index.insert(entries[i].url, i);
+            dirty = false;
+        }
+        return index.value(url, -1);
+    };
+
+    _records = 0;
+    qint64 validSize = ds.device()->pos();
+    while (!ds.atEnd()) {
+        quint8 op = 0;
+        Entry e;
+        QUrl url;
+        qint32 to = -1;
+
+        ds >> op;
+        switch (op) {
+            case OpAppend:
+            case OpUpdate:
+                ds >> e.url >> e.valid >> e.mi >> e.id;
+                break;
+            case OpRemove:
+                ds >> url;
+                break;
+            case OpMove:
+                ds >> url >> to;
+                break;
+            default:
+                ds.setStatus(QDataStream::ReadCorruptData);
+        }
+        // a record cut short by a crash ends the log
+        if (ds.status() != QDataStream::Ok) break;
+        validSize = ds.device()->pos();
+        _records++;
+
+        switch (op) {
+            case OpAppend:
+                if (rowOf(e.url) < 0) {
+                    index.insert(e.url, entries.size());
+                    entries.append(e);
+                }
+                break;
+            case OpUpdate: {
+                auto row = rowOf(e.url);
+                if (row >= 0) entries[row] = e;
+                break;
+            }
+            case OpRemove: {
+                auto row = rowOf(url);
+                if (row >= 0) {
+                    entries.removeAt(row);
+                    dirty = true;
+                }
+                break;
+            }
+            case OpMove: {
+                auto row = rowOf(url);
+                if (row >= 0 && to >= 0 && to < entries.size()) {
+                    entries.move(row, to);
+                    dirty = true;
+                }
+                break;
+            }
+        }
+    }
+
+    qDebug() << "journal replayed" << _records << "records into" << entries.size() << "items";
+    if (!locked) return entries;
+
+    if (_records > entries.size() * 2 + 256) {
+        writeSnapshot(entries);
+        return entries;
+    }
+    if (validSize < data.size()) {
+        // drop the torn tail, or records appended later won't be readable
+        _file.resize(validSize);
+    }
+    unlock();
+    return entries;
+}
+
+void PlaylistJournal::record(Op op, const PlayItemInfo *pif, const QUrl& url, int to)
+{
+    if (_readOnly) return;
+
+    QDataStream ds(&_pending, QIODevice::Append);
+    ds.setVersion(QDataStream::Qt_5_0);
+    ds << (quint8)op;
+    switch (op) {
+        case OpAppend:
+        case OpUpdate:
+            ds << pif->url << pif->valid << pif->mi << pif->id;
+            break;
+        case OpRemove:
+            ds << url;
+            break;
+        case OpMove:
+            ds << url << (qint32)to;
+            break;
+    }
+
+    _records++;
+    if (!_flushTimer.isActive()) _flushTimer.start();
+}
+
+void PlaylistJournal::recordAppend(const PlayItemInfo& pif)
+{
+    record(OpAppend, &pif, pif.url);
+}
+
+void PlaylistJournal::recordUpdate(const PlayItemInfo& pif)
+{
+    record(OpUpdate, &pif, pif.url);
+}
+
+void PlaylistJournal::recordRemove(const QUrl& url)
+{
+    record(OpRemove, nullptr, url);
+}
+
+void PlaylistJournal::recordMove(const QUrl& url, int to)
+{
+    record(OpMove, nullptr, url, to);
+}
+
+void PlaylistJournal::reset()
+{
+    if (_readOnly) return;
+
+    _pending.clear();
+    _flushTimer.stop();
+    if (lockForWrite()) writeSnapshot(QList<Entry>());
+}
+
+bool PlaylistJournal::lockForWrite()
+{
+    // another instance may replace the file with a snapshot while it's
+    // open here, appending to the old one would lose the records
+    for (int tries = 0; tries < 4; tries++) {
+        if (!_file.isOpen() && !_file.open(QIODevice::WriteOnly | QIODevice::Append
+                    | QIODevice::Unbuffered)) {
+            qWarning() << "open playlist journal failed" << _file.errorString();
+            return false;
+        }
+
+        if (::flock(_file.handle(), LOCK_EX) != 0) {
+            qWarning() << "lock playlist journal failed" << strerror(errno);
+            return false;
+        }
+
+        struct stat opened, named;
+        if (::fstat(_file.handle(), &opened) == 0
+                && ::stat(QFile::encodeName(_path).constData(), &named) == 0
+                && opened.st_dev == named.st_dev && opened.st_ino == named.st_ino) {
+            if (opened.st_size == 0) {
+                QDataStream ds(&_file);
+                ds << kJournalMagic << kJournalVersion;
+            }
+            return true;
+        }
+
+        // replaced or removed since, closing drops the lock too
+        _file.close();
+    }
+
+    qWarning() << "playlist journal keeps being replaced" << _path;
+    return false;
+}
+
+void PlaylistJournal::unlock()
+{
+    ::flock(_file.handle(), LOCK_UN);
+}
+
+bool PlaylistJournal::flush()
+{
+    if (_readOnly || _pending.isEmpty()) return true;
+
+    bool ok = false;
+    if (lockForWrite()) {
+        // unbuffered, it's all in the file before the lock is dropped
+        ok = _file.write(_pending) == _pending.size();
+        if (!ok) {
+            qWarning() << "write playlist journal failed" << _file.errorString();
+        }
+        unlock();
+    }
+    _pending.clear();
+    return ok;
+}
+
+bool PlaylistJournal::writeSnapshot(const QList<Entry>& entries)
+{
+    // called with the lock held. the new file is renamed over the old one,
+    // closing the old handle afterwards drops the lock, and the next write
+    // opens the new file
+    QSaveFile f(_path);
+    bool ok = f.open(QIODevice::WriteOnly);
+    if (ok) {
+        QDataStream ds(&f);
+        ds.setVersion(QDataStream::Qt_5_0);
+        ds << kJournalMagic << kJournalVersion;
+        for (const auto& e: entries) {
+            ds << (quint8)OpAppend << e.url << e.valid << e.mi << e.id;
+        }
+        ok = f.commit();
+    }
+
+    if (ok) {
+        _records = entries.size();
+    } else {
+        qWarning() << "write playlist journal failed" << f.errorString();
+    }
+    _file.close();
+    return ok;
+}
+
+}
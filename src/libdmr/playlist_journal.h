@@ -0,0 +1,108 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_PLAYLIST_JOURNAL_H
+#define _DMR_PLAYLIST_JOURNAL_H 
+
+#include "playlist_model.h"
+
+namespace dmr {
+
+/* The playlist persisted as a binary log of operations. Every change of the
+ * playlist appends one record, and startup replays the whole file in one
+ * read. Items carry their MovieInfo and file identity, so they can be shown
+ * right away and revalidated later.
+ *
+ * The journal belongs to the first instance that opens it for writing.
+ * Instances started while it runs (MultipleInstance) restore the list it
+ * holds, but keep their own changes to themselves. Playlists of several
+ * windows are never merged, and clearing one doesn't wipe the others.
+ * Writes still hold a flock on the file, and reopen it when it has been
+ * replaced meanwhile.
+ *
+ * load() compacts the log into a snapshot once it has grown much longer
+ * than the list it holds.
+ */
+class PlaylistJournal: public QObject {
+    Q_OBJECT
+public:
+    struct Entry {
+        QUrl url;
+        bool valid;
+        struct MovieInfo mi;
+        FileIdentity id;
+    };
+
+    // a read only journal never writes anything. neither does one whose
+    // file is owned by another instance already
+    PlaylistJournal(const QString& path, bool readOnly = false);
+    ~PlaylistJournal();
+
+    bool exists() const { return QFile::exists(_path); }
+    bool readOnly() const { return _readOnly; }
+    QList<Entry> load();
+
+    void recordAppend(const PlayItemInfo& pif);
+    void recordUpdate(const PlayItemInfo& pif);
+    void recordRemove(const QUrl& url);
+    void recordMove(const QUrl& url, int to);
+    // drops everything, the playlist is empty afterwards
+    void reset();
+
+public slots:
+    // records are buffered and written shortly after. false if some
+    // could not be written
+    bool flush();
+
+private:
+    enum Op: quint8 {
+        OpAppend = 1,
+        OpUpdate,
+        OpRemove,
+        OpMove,
+    };
+
+    QString _path;
+    bool _readOnly;
+    int _ownerFd {-1}; // locked for as long as this instance writes
+    QFile _file;
+    QByteArray _pending;
+    QTimer _flushTimer;
+    int _records {0};
+
+    void record(Op op, const PlayItemInfo *pif, const QUrl& url, int to = -1);
+    bool takeOwnership();
+    bool lockForWrite();
+    void unlock();
+    bool writeSnapshot(const QList<Entry>& entries);
+};
+
+}
+
+#endif /* ifndef _DMR_PLAYLIST_JOURNAL_H */
@@ -34,9 +34,11 @@
 #include "dmr_settings.h"
 #endif
 #include "dvd_utils.h"
+#include "probe_scheduler.h"
+#include "packed_cache.h"
+#include "playlist_journal.h"
+#include "frame_decoder.h"
 
-
-#include <libffmpegthumbnailer/videothumbnailer.h>
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/dict.h>
@@ -45,50 +47,110 @@ extern "C" {
 
 #include <random>
 
-static int open_codec_context(int *stream_idx,
-        AVCodecContext **dec_ctx, AVFormatContext *fmt_ctx, enum AVMediaType type)
+static void stream_size(AVStream *st, int *w, int *h)
+{
+#if LIBAVFORMAT_VERSION_MAJOR >= 57 && LIBAVFORMAT_VERSION_MINOR <= 25
+    *w = st->codec->width;
+    *h = st->codec->height;
+#else
+    *w = st->codecpar->width;
+    *h = st->codecpar->height;
+#endif
+}
+
+static bool stream_decodable(AVStream *st)
+{
+#if LIBAVFORMAT_VERSION_MAJOR >= 57 && LIBAVFORMAT_VERSION_MINOR <= 25
+    return avcodec_find_decoder(st->codec->codec_id) != NULL;
+#else
+    return avcodec_find_decoder(st->codecpar->codec_id) != NULL;
+#endif
+}
+
+// in AV_TIME_BASE units, 0 if unknown
+static int64_t format_duration(AVFormatContext *fmt_ctx)
+{
+    if (fmt_ctx->duration != AV_NOPTS_VALUE && fmt_ctx->duration > 0)
+        return fmt_ctx->duration;
+
+    int64_t duration = 0;
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+        auto *st = fmt_ctx->streams[i];
+        if (st->duration != AV_NOPTS_VALUE && st->duration > 0)
+            duration = qMax(duration, av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q));
+    }
+    return duration;
+}
+
+// mp4 and matroska (webm) headers already carry duration and dimensions,
+// there is no need to read and decode packets for them
+static bool header_is_complete(AVFormatContext *fmt_ctx)
 {
-    int ret, stream_index;
-    AVStream *st;
-    AVCodec *dec = NULL;
+    QByteArray name(fmt_ctx->iformat->name);
+    if (!name.contains("mov") && !name.contains("matroska"))
+        return false;
+
+    auto idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (idx < 0) return false;
+
+    int w = 0, h = 0;
+    stream_size(fmt_ctx->streams[idx], &w, &h);
+    return w > 0 && h > 0 && format_duration(fmt_ctx) > 0;
+}
+
+static int probe_interrupted(void *opaque)
+{
+    return ((const QAtomicInt*)opaque)->load() != 0;
+}
+
+// opens and probes path into *fmt_ctx, which the caller always closes.
+// quick probing trusts container headers and caps the probing budget.
+// returns index of the video stream, or a negative error
+static int probe_video_stream(const QByteArray& path, bool quick, AVFormatContext **fmt_ctx,
+        const QAtomicInt *canceled)
+{
+    if (canceled) {
+        // io gives up as well, not just the steps in between
+        *fmt_ctx = avformat_alloc_context();
+        if (!*fmt_ctx) return AVERROR(ENOMEM);
+        (*fmt_ctx)->interrupt_callback.callback = probe_interrupted;
+        (*fmt_ctx)->interrupt_callback.opaque = (void*)canceled;
+    }
+
     AVDictionary *opts = NULL;
-    ret = av_find_best_stream(fmt_ctx, type, -1, -1, NULL, 0);
+    if (quick) {
+        av_dict_set(&opts, "probesize", "262144", 0);
+        av_dict_set(&opts, "analyzeduration", "500000", 0);
+    }
+    auto ret = avformat_open_input(fmt_ctx, path.constData(), NULL, &opts);
+    av_dict_free(&opts);
     if (ret < 0) {
-        qWarning() << "Could not find " << av_get_media_type_string(type)
-            << " stream in input file";
+        qWarning() << "avformat: could not open input";
         return ret;
     }
 
-    stream_index = ret;
-    st = fmt_ctx->streams[stream_index];
-#if LIBAVFORMAT_VERSION_MAJOR >= 57 && LIBAVFORMAT_VERSION_MINOR <= 25
-    *dec_ctx = st->codec;
-    dec = avcodec_find_decoder((*dec_ctx)->codec_id);
-#else
-    /* find decoder for the stream */
-    dec = avcodec_find_decoder(st->codecpar->codec_id);
-    if (!dec) {
-        fprintf(stderr, "Failed to find %s codec\n",
-                av_get_media_type_string(type));
-        return AVERROR(EINVAL);
-    }
-    /* Allocate a codec context for the decoder */
-    *dec_ctx = avcodec_alloc_context3(dec);
-    if (!*dec_ctx) {
-        fprintf(stderr, "Failed to allocate the %s codec context\n",
-                av_get_media_type_string(type));
-        return AVERROR(ENOMEM);
+    if (!quick || !header_is_complete(*fmt_ctx)) {
+        if ((ret = avformat_find_stream_info(*fmt_ctx, NULL)) < 0) {
+            qWarning() << "av_find_stream_info failed";
+            return ret;
+        }
     }
-    /* Copy codec parameters from input stream to output codec context */
-    if ((ret = avcodec_parameters_to_context(*dec_ctx, st->codecpar)) < 0) {
-        fprintf(stderr, "Failed to copy %s codec parameters to decoder context\n",
-                av_get_media_type_string(type));
+
+    if ((*fmt_ctx)->nb_streams == 0)
+        return AVERROR_STREAM_NOT_FOUND;
+
+    ret = av_find_best_stream(*fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (ret < 0) {
+        qWarning() << "Could not find video stream in input file";
         return ret;
     }
-#endif
 
-    *stream_idx = stream_index;
-    return 0;
+    if (!stream_decodable((*fmt_ctx)->streams[ret])) {
+        qWarning() << "Failed to find video codec";
+        return AVERROR(EINVAL);
+    }
+
+    return ret;
 }
 
 
@@ -145,12 +207,36 @@ QDataStream& operator>> (QDataStream& st, MovieInfo& mi)
 
 static class PersistentManager* _persistentManager = nullptr;
 
-static QString hashUrl(const QUrl& url)
+// kinds of jobs for ProbeScheduler
+enum ProbeKind {
+    MetaProbe,
+    ThumbProbe,
+    RevalidateProbe,
+};
+
+// key of a cache record, kind is 'i' for movie info and one per thumbnail
+// tier, see thumbKind
+static QByteArray cacheKey(char kind, const QUrl& url)
+{
+    return QByteArray(1, kind) + QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha256);
+}
+
+static char thumbKind(PlaylistModel::ThumbnailTier tier)
 {
-    return QString(QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha256).toHex());
+    return tier == PlaylistModel::PlaylistThumb ? 'l' : 'p';
 }
 
-//TODO: clean cache periodically
+// prefix of a stored thumbnail, followed by raw premultiplied argb32 pixels
+struct ThumbHeader {
+    quint32 width;
+    quint32 height;
+    quint32 bytesPerLine;
+    float dpr;
+};
+
+// every cache record starts with the identity of the file it was computed
+// from, see FileIdentity
+
 class PersistentManager: public QObject
 {
     Q_OBJECT
@@ -164,150 +250,206 @@ public:
 
     struct CacheInfo {
         struct MovieInfo mi;
-        QPixmap thumb;
         bool mi_valid {false};
-        bool thumb_valid {false};
     };
 
+    // all lookups read from the shared mapping of the pack, and are safe
+    // to call from probe threads
     CacheInfo loadFromCache(const QUrl& url)
     {
-        auto h = hashUrl(url);
         CacheInfo ci;
-        
-        {
-            auto filename = QString("%1/%2").arg(_cacheInfoPath).arg(h);
-            QFile f(filename);
-            if (!f.exists()) return ci;
-
-            if (f.open(QIODevice::ReadOnly)) {
-                QDataStream ds(&f);
-                ds >> ci.mi;
-                ci.mi_valid = ci.mi.valid;
-            } else {
-                qWarning() << f.errorString();
-            }
-        }
-        
-        if (ci.mi_valid) {
-            auto filename = QString("%1/%2").arg(_pixmapCachePath).arg(h);
-            QFile f(filename);
-            if (!f.exists()) return ci;
-
-            if (f.open(QIODevice::ReadOnly)) {
-                QDataStream ds(&f);
-                ds >> ci.thumb;
-                ci.thumb.setDevicePixelRatio(qApp->devicePixelRatio());
-                ci.thumb_valid = !ci.thumb.isNull();
-            } else {
-                qWarning() << f.errorString();
-            }
-        }
+        auto data = lookup('i', url);
+        if (data.isEmpty()) return ci;
 
+        QDataStream ds(data);
+        ds >> ci.mi;
+        ci.mi_valid = ds.status() == QDataStream::Ok && ci.mi.valid;
         return ci;
     }
 
-    void save(const PlayItemInfo& pif)
+    // thumbnails are loaded on demand, see PlaylistModel::thumbnail.
+    // the image refers to the mapped pack directly, and keeps it mapped
+    QImage loadThumb(const QUrl& url, PlaylistModel::ThumbnailTier tier)
     {
-        auto h = hashUrl(pif.url);
+        PackedCache::Hold hold;
+        auto data = lookup(thumbKind(tier), url, &hold);
+        if (data.size() < (int)sizeof(ThumbHeader)) return QImage();
+
+        auto *h = (const ThumbHeader*)data.constData();
+        if (data.size() < (int)(sizeof(ThumbHeader) + h->bytesPerLine * h->height))
+            return QImage();
+
+        QImage img((const uchar*)data.constData() + sizeof(ThumbHeader), h->width, h->height,
+                h->bytesPerLine, QImage::Format_ARGB32_Premultiplied,
+                PackedCache::releaseHold, new PackedCache::Hold(hold));
+        img.setDevicePixelRatio(h->dpr);
+        return img;
+    }
 
-        bool mi_saved = false;
-        
+    void saveInfo(const QUrl& url, const MovieInfo& mi)
+    {
+        QByteArray data;
         {
-            auto filename = QString("%1/%2").arg(_cacheInfoPath).arg(h);
-            QFile f(filename);
-            if (f.open(QIODevice::WriteOnly)) {
-                QDataStream ds(&f);
-                ds << pif.mi;
-                mi_saved = true;
-                qDebug() << "cache" << pif.url << "->" << h;
-            } else {
-                qWarning() << f.errorString();
-            }
-        }
-        
-        if (mi_saved) {
-            auto filename = QString("%1/%2").arg(_pixmapCachePath).arg(h);
-            QFile f(filename);
-            if (f.open(QIODevice::WriteOnly)) {
-                QDataStream ds(&f);
-                ds << pif.thumbnail;
-            } else {
-                qWarning() << f.errorString();
-            }
+            QDataStream ds(&data, QIODevice::WriteOnly);
+            ds << mi;
         }
+        if (store('i', url, data))
+            qDebug() << "cache" << url;
+    }
+
+    // img should already be premultiplied, which is what the raster engine
+    // paints from without conversion
+    void saveThumb(const QUrl& url, PlaylistModel::ThumbnailTier tier, const QImage& img)
+    {
+        Q_ASSERT(img.format() == QImage::Format_ARGB32_Premultiplied);
+        ThumbHeader h {(quint32)img.width(), (quint32)img.height(),
+            (quint32)img.bytesPerLine(), (float)img.devicePixelRatio()};
+        QByteArray data((const char*)&h, sizeof h);
+        data.append((const char*)img.constBits(), img.bytesPerLine() * img.height());
+        store(thumbKind(tier), url, data);
     }
 
     bool cacheExists(const QUrl& url) 
     {
-        auto h = hashUrl(url);
-        auto filename = QString("%1/%2").arg(_cacheInfoPath).arg(h);
-        return QFile::exists(filename);
+        return _pack->contains(cacheKey('i', url));
+    }
+
+    CacheStats stats() const
+    {
+        return CacheStats {_hits.load(), _misses.load(), _stale.load(),
+            _collected.load(), _pack->fileSize()};
+    }
+
+public slots:
+    void collectGarbage()
+    {
+        if (!_gcRunning.testAndSetOrdered(0, 1)) return;
+
+        QtConcurrent::run([=]() {
+            QElapsedTimer t;
+            t.start();
+            auto n = _pack->compact(MAX_CACHE_SIZE, MAX_CACHE_AGE);
+            if (n > 0) _collected.fetchAndAddRelaxed(n);
+            _gcFutile.store(n <= 0);
+
+            auto st = stats();
+            qDebug() << "cache gc dropped" << n << "in" << t.elapsed() << "ms, size"
+                << st.fileSize << "hits" << st.hits << "misses" << st.misses
+                << "stale" << st.stale;
+            _gcRunning.store(0);
+        });
     }
 
 private:
+    enum {
+        MAX_CACHE_SIZE = 256 << 20,
+        MAX_CACHE_AGE = 90 * 24 * 3600, // secs since the entry was last used
+        GC_INTERVAL = 6 * 3600 * 1000,
+    };
+
+    PackedCache *_pack {nullptr};
+    QTimer _gcTimer;
+    QAtomicInt _gcRunning {0};
+    QAtomicInt _gcFutile {0}; // last pass dropped nothing
+    QAtomicInt _hits {0};
+    QAtomicInt _misses {0};
+    QAtomicInt _stale {0};
+    QAtomicInt _collected {0};
+
     PersistentManager() 
     {
         auto tmpl = QString("%1/%2/%3/%4")
             .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation))
             .arg(qApp->organizationName())
             .arg(qApp->applicationName());
-        {
-            _cacheInfoPath = tmpl.arg("cacheinfo");
-            QDir d;
-            d.mkpath(_cacheInfoPath);
+        QDir().mkpath(tmpl.arg(""));
+
+        // per url files used before the pack, nothing reads them anymore
+        QDir(tmpl.arg("cacheinfo")).removeRecursively();
+        QDir(tmpl.arg("thumbs")).removeRecursively();
+
+        _pack = new PackedCache(tmpl.arg("cache.pack"));
+
+        // first run is deferred to stay out of the way of startup
+        connect(&_gcTimer, &QTimer::timeout, this, &PersistentManager::collectGarbage);
+        _gcTimer.start(GC_INTERVAL);
+        QTimer::singleShot(60 * 1000, this, &PersistentManager::collectGarbage);
+    }
+
+    // payload of a record, empty if missing or the file has changed since.
+    // see PackedCache::find for hold
+    QByteArray lookup(char kind, const QUrl& url, PackedCache::Hold *hold = nullptr)
+    {
+        auto data = _pack->find(cacheKey(kind, url), hold);
+        if (data.size() < (int)sizeof(FileIdentity)) {
+            _misses.ref();
+            return QByteArray();
         }
-        {
-            _pixmapCachePath = tmpl.arg("thumbs");
-            QDir d;
-            d.mkpath(_pixmapCachePath);
+
+        auto id = fileIdentity(url);
+        if (memcmp(data.constData(), &id, sizeof id) != 0) {
+            _stale.ref();
+            return QByteArray();
         }
-    }
 
-    QString _pixmapCachePath;
-    QString _cacheInfoPath;
+        _hits.ref();
+        if (!hold) return data.mid(sizeof id);
+        return QByteArray::fromRawData(data.constData() + sizeof id, data.size() - sizeof id);
+    }
 
+    bool store(char kind, const QUrl& url, const QByteArray& payload)
+    {
+        auto id = fileIdentity(url);
+        QByteArray data((const char*)&id, sizeof id);
+        data.append(payload);
+        if (_pack->insert(cacheKey(kind, url), data)) return true;
+
+        // full, make room for the next ones. if the last pass could not,
+        // it's left to the periodic one instead of rewriting the file again
+        if (!_gcFutile.load())
+            QMetaObject::invokeMethod(this, "collectGarbage", Qt::QueuedConnection);
+        return false;
+    }
 };
 
-struct MovieInfo MovieInfo::parseFromFile(const QFileInfo& fi, bool *ok)
+struct MovieInfo MovieInfo::parseFromFile(const QFileInfo& fi, bool *ok, ProbeMode mode,
+        const QAtomicInt *canceled)
 {
     struct MovieInfo mi;
     mi.valid = false;
-    AVFormatContext *av_ctx = NULL;
-    int stream_id = -1;
-    AVCodecContext *dec_ctx = NULL;
+    if (ok) *ok = false;
 
     if (!fi.exists()) {
-        if (ok) *ok = false;
         return mi;
     }
 
-    auto ret = avformat_open_input(&av_ctx, fi.filePath().toUtf8().constData(), NULL, NULL);
-    if (ret < 0) {
-        qWarning() << "avformat: could not open input";
-        if (ok) *ok = false;
+    auto path = fi.filePath().toUtf8();
+    AVFormatContext *av_ctx = NULL;
+    int w = 0, h = 0;
+    auto stream_id = probe_video_stream(path, mode == QuickProbe, &av_ctx, canceled);
+    if (stream_id >= 0) stream_size(av_ctx->streams[stream_id], &w, &h);
+
+    if (canceled && canceled->load()) {
+        avformat_close_input(&av_ctx);
         return mi;
     }
 
-    if (avformat_find_stream_info(av_ctx, NULL) < 0) {
-        qWarning() << "av_find_stream_info failed";
-        if (ok) *ok = false;
-        return mi;
+    // opened fine, but the capped budget was not enough to tell
+    if (mode == QuickProbe && av_ctx && (stream_id < 0 || w <= 0 || h <= 0)) {
+        qDebug() << "quick probe inconclusive, fall back to full probe" << fi.fileName();
+        avformat_close_input(&av_ctx);
+        stream_id = probe_video_stream(path, false, &av_ctx, canceled);
+        if (stream_id >= 0) stream_size(av_ctx->streams[stream_id], &w, &h);
     }
 
-    if (av_ctx->nb_streams == 0) {
-        if (ok) *ok = false;
-        return mi;
-    } 
-    if (open_codec_context(&stream_id, &dec_ctx, av_ctx, AVMEDIA_TYPE_VIDEO) < 0) {
-        if (ok) *ok = false;
+    if (stream_id < 0) {
+        avformat_close_input(&av_ctx);
         return mi;
     }
 
-    av_dump_format(av_ctx, 0, fi.fileName().toUtf8().constData(), 0);
-
-    mi.width = dec_ctx->width;
-    mi.height = dec_ctx->height;
-    auto duration = av_ctx->duration == AV_NOPTS_VALUE ? 0 : av_ctx->duration;
+    mi.width = w;
+    mi.height = h;
+    auto duration = format_duration(av_ctx);
     duration = duration + (duration <= INT64_MAX - 5000 ? 5000 : 0);
     mi.duration = duration / AV_TIME_BASE;
     mi.resolution = QString("%1x%2").arg(mi.width).arg(mi.height);
@@ -367,25 +509,33 @@ bool PlayItemInfo::refresh()
 PlaylistModel::PlaylistModel(PlayerEngine *e)
     :_engine(e)
 {
-    _thumbnailer.setThumbnailSize(400 * qApp->devicePixelRatio());
     av_register_all();
 
-    _playlistFile = QString("%1/%2/%3/playlist")
+    auto dir = QString("%1/%2/%3")
         .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation))
         .arg(qApp->organizationName())
         .arg(qApp->applicationName());
+    _playlistFile = dir + "/playlist";
+#ifdef _LIBDMR_
+    _journal = new PlaylistJournal(dir + "/playlist.journal", true);
+#else
+    _journal = new PlaylistJournal(dir + "/playlist.journal");
+#endif
 
-    connect(e, &PlayerEngine::stateChanged, [=]() {
+    connect(e, &PlayerEngine::stateChanged, this, [=]() {
         qDebug() << "model" << "_userRequestingItem" << _userRequestingItem << "state" << e->state();
         switch (e->state()) {
             case PlayerEngine::Playing:
             {
+                // the load may finish after the playlist was cleared
+                if (_current < 0 || _current >= count()) break;
                 auto& pif = currentInfo();
                 if (!pif.url.isLocalFile() && !pif.loaded) {
                     pif.mi.width = e->videoSize().width();
                     pif.mi.height = e->videoSize().height();
                     pif.mi.duration = e->duration();
                     pif.loaded = true;
+                    _journal->recordUpdate(pif);
                     emit itemInfoUpdated(_current);
                 }
                 break;
@@ -394,7 +544,7 @@ PlaylistModel::PlaylistModel(PlayerEngine *e)
                 break;
 
             case PlayerEngine::Idle:
-                if (!_userRequestingItem) {
+                if (!_userRequestingItem && !e->endRequested()) {
                     stop();
                     playNext(false);
                 }
@@ -402,9 +552,13 @@ PlaylistModel::PlaylistModel(PlayerEngine *e)
         }
     });
 
-    _jobWatcher = new QFutureWatcher<PlayItemInfo>();
-    connect(_jobWatcher, &QFutureWatcher<PlayItemInfo>::finished,
-            this, &PlaylistModel::onAsyncAppendFinished);
+    // probe jobs use it concurrently, make sure it gets created here
+    PersistentManager::get();
+
+    _thumbs.setMaxCost(32 << 20);
+
+    _prober = new ProbeScheduler(this);
+    connect(_prober, &ProbeScheduler::finished, this, &PlaylistModel::onProbeFinished);
 
     stop();
     loadPlaylist();
@@ -413,72 +567,110 @@ PlaylistModel::PlaylistModel(PlayerEngine *e)
 PlaylistModel::~PlaylistModel()
 {
     qDebug() << __func__;
-    delete _jobWatcher;
+    // running probes use the model, wait for them before it's gone
+    delete _prober;
+    _prober = nullptr;
 
 #ifndef _LIBDMR_
     if (Settings::get().isSet(Settings::ClearWhenQuit)) {
-        clearPlaylist();
-    } else {
-        //persistently save current playlist 
-        savePlaylist();
+        _journal->reset();
     }
 #endif
+    // the journal is always up to date, only buffered records are left
+    delete _journal;
+    _journal = nullptr;
 }
 
-void PlaylistModel::clearPlaylist()
-{
-    QSettings cfg(_playlistFile, QSettings::NativeFormat);
-    cfg.beginGroup("playlist");
-    cfg.remove("");
-    cfg.endGroup();
-}
-
-void PlaylistModel::savePlaylist()
+void PlaylistModel::loadPlaylist()
 {
-    QSettings cfg(_playlistFile, QSettings::NativeFormat);
-    cfg.beginGroup("playlist");
-    cfg.remove("");
+    // restored items are shown as they were saved, local ones get
+    // revalidated in the background
+    QList<PlaylistJournal::Entry> entries;
+    if (_journal->exists()) entries = _journal->load();
+    _infos.reserve(entries.size());
+    for (const auto& e: entries) {
+        if (_urlIndex.contains(e.url)) continue;
+
+        PlayItemInfo pif;
+        if (e.url.isLocalFile()) {
+            pif = PlayItemInfo { e.valid, true, e.url, QFileInfo(e.url.toLocalFile()), e.mi, e.id };
+            requestRevalidation(pif.url, e.id);
+        } else {
+            pif = calculatePlayInfo(e.url, QFileInfo());
+        }
+        _urlIndex.insert(pif.url, _infos.size());
+        _infos.append(pif);
+    }
+    if (count() > 0) emit itemsAppended(0, count());
 
-    for (int i = 0; i < count(); ++i) {
-        const auto& pif = _infos[i];
-        cfg.setValue(QString::number(i), pif.url);
-        qDebug() << "save " << pif.url;
+    // left by an older version, or by an import that was cut short
+    if (QFile::exists(_playlistFile)) {
+        loadLegacyPlaylist();
+        return;
     }
-    cfg.endGroup();
-    cfg.sync();
+
+    _firstLoad = false;
+    reshuffle();
+    emit countChanged();
 }
 
-void PlaylistModel::loadPlaylist()
+// playlists used to be kept in QSettings, import it once through the usual
+// async probing. items already in the journal are skipped
+void PlaylistModel::loadLegacyPlaylist()
 {
     QList<QUrl> urls;
 
-    QSettings cfg(_playlistFile, QSettings::NativeFormat);
-    cfg.beginGroup("playlist");
-    auto keys = cfg.childKeys();
-    for (int i = 0; i < keys.size(); ++i) {
-        auto url = cfg.value(QString::number(i)).toUrl();
-        if (indexOf(url) >= 0) continue;
+    {
+        QSettings cfg(_playlistFile, QSettings::NativeFormat);
+        cfg.beginGroup("playlist");
+        auto keys = cfg.childKeys();
+        for (int i = 0; i < keys.size(); ++i) {
+            auto url = cfg.value(QString::number(i)).toUrl();
+            if (indexOf(url) >= 0) continue;
 
-        if (url.isLocalFile()) {
-            urls.append(url);
+            if (url.isLocalFile()) {
+                urls.append(url);
 
-        } else {
-            auto pif = calculatePlayInfo(url, QFileInfo());
-            _infos.append(pif);
+            } else {
+                auto pif = calculatePlayInfo(url, QFileInfo());
+                appendItem(pif);
+            }
         }
+        cfg.endGroup();
     }
-    cfg.endGroup();
 
     if (urls.size() == 0) {
+        finishLegacyImport();
         _firstLoad = false;
         reshuffle();
         emit countChanged();
         return;
     }
 
+    _legacyImport = true;
     QTimer::singleShot(0, [=]() { delayedAppendAsync(urls); });
 }
 
+// the old playlist goes away only once all of it is in the journal
+void PlaylistModel::finishLegacyImport()
+{
+    _legacyImport = false;
+    // nothing is written then, and the file belongs to the app anyway
+    if (_journal->readOnly()) return;
+
+    if (_journal->flush()) {
+        QFile::remove(_playlistFile);
+    }
+}
+
+void PlaylistModel::requestRevalidation(const QUrl& url, const FileIdentity& id)
+{
+    _prober->schedule(RevalidateProbe, url, [=](const QAtomicInt& canceled) {
+        if (fileIdentity(url) == id) return QVariant();
+        return QVariant::fromValue(calculatePlayInfo(url, QFileInfo(url.toLocalFile()), &canceled));
+    });
+}
+
 
 PlaylistModel::PlayMode PlaylistModel::playMode() const
 {
@@ -515,8 +707,29 @@ void PlaylistModel::reshuffle()
 
 void PlaylistModel::clear()
 {
+    _prober->cancelAll();
+    _pendingAppendReq.clear();
+    _pendingJob.clear();
+    _urlsInJob.clear();
+    _jobIndex.clear();
+    _jobRemaining = 0;
+    _jobCursor = 0;
+    _jobResults.clear();
+    _jobSkipped.clear();
+    _jobBatch.clear();
+    _jobAppended.clear();
+    _userRequestedUrl = QUrl();
+    _firstLoad = false;
+
     _infos.clear();
-    _engine->waitLastEnd();
+    _urlIndex.clear();
+    _journal->reset();
+    // cleared before its import finished, don't bring it back next time
+    if (_legacyImport) finishLegacyImport();
+    _thumbs.clear();
+    _thumbFailed.clear();
+    _visibleFirst = _visibleLast = -1;
+    _engine->endLastPlayback();
 
     _current = -1;
     _last = -1;
@@ -531,7 +744,15 @@ void PlaylistModel::remove(int pos)
 
     _userRequestingItem = true;
 
+    _prober->cancel(ThumbProbe, _infos[pos].url);
+    _prober->cancel(RevalidateProbe, _infos[pos].url);
+    _journal->recordRemove(_infos[pos].url);
+    _thumbs.remove(_infos[pos].url);
+    // it may be fixed by the time it's added again
+    _thumbFailed.remove(_infos[pos].url);
+    _urlIndex.remove(_infos[pos].url);
     _infos.removeAt(pos);
+    reindex(pos);
     reshuffle();
 
     _last = _current;
@@ -539,7 +760,7 @@ void PlaylistModel::remove(int pos)
         if (_current == pos) {
             _last = _current;
             _current = -1;
-            _engine->waitLastEnd();
+            _engine->endLastPlayback();
 
         } else if (pos < _current) {
             _current--;
@@ -571,6 +792,8 @@ void PlaylistModel::tryPlayCurrent(bool next)
     auto& pif = _infos[_current];
     if (pif.refresh()) {
         qDebug() << pif.url.fileName() << "changed";
+        pif.id = fileIdentity(pif.url);
+        _journal->recordUpdate(pif);
     }
     emit itemInfoUpdated(_current);
     if (pif.valid) {
@@ -598,7 +821,7 @@ void PlaylistModel::playNext(bool fromUser)
                 if (_last + 1 >= count()) {
                     _last = -1;
                 }
-                _engine->waitLastEnd();
+                _engine->endLastPlayback();
                 _current = _last + 1;
                 _last = _current;
                 tryPlayCurrent(true);
@@ -616,7 +839,7 @@ void PlaylistModel::playNext(bool fromUser)
                     if (_last + 1 >= count()) {
                         _last = -1;
                     }
-                    _engine->waitLastEnd();
+                    _engine->endLastPlayback();
                     _current = _last + 1;
                     _last = _current;
                     tryPlayCurrent(true);
@@ -640,7 +863,7 @@ void PlaylistModel::playNext(bool fromUser)
             }
             _shufflePlayed++;
             qDebug() << "shuffle next " << _shufflePlayed-1;
-            _engine->waitLastEnd();
+            _engine->endLastPlayback(_playOrder[_shufflePlayed-1]);
             _last = _current = _playOrder[_shufflePlayed-1];
             tryPlayCurrent(true);
             break;
@@ -657,7 +880,7 @@ void PlaylistModel::playNext(bool fromUser)
                 }
             }
 
-            _engine->waitLastEnd();
+            _engine->endLastPlayback(_last);
             _current = _last;
             tryPlayCurrent(true);
             break;
@@ -669,7 +892,7 @@ void PlaylistModel::playNext(bool fromUser)
                 _last = 0;
             }
 
-            _engine->waitLastEnd();
+            _engine->endLastPlayback(_last);
             _current = _last;
             tryPlayCurrent(true);
             break;
@@ -678,6 +901,32 @@ void PlaylistModel::playNext(bool fromUser)
     _userRequestingItem = false;
 }
 
+int PlaylistModel::predictNext() const
+{
+    if (_current < 0 || count() < 2) return -1;
+
+    int id = -1;
+    switch (_playMode) {
+        case OrderPlay:
+            if (_last + 1 < count()) id = _last + 1;
+            break;
+
+        case ListLoop:
+            id = (_last + 1) % count();
+            break;
+
+        case ShufflePlay:
+            if (_shufflePlayed < _playOrder.size()) id = _playOrder[_shufflePlayed];
+            break;
+
+        default:
+            break;
+    }
+
+    if (id < 0 || id == _current || !_infos[id].valid) return -1;
+    return id;
+}
+
 void PlaylistModel::playPrev(bool fromUser)
 {
     if (count() == 0) return;
@@ -692,7 +941,7 @@ void PlaylistModel::playPrev(bool fromUser)
                 if (_last - 1 < 0) {
                     _last = count();
                 }
-                _engine->waitLastEnd();
+                _engine->endLastPlayback();
                 _current = _last - 1;
                 _last = _current;
                 tryPlayCurrent(false);
@@ -710,7 +959,7 @@ void PlaylistModel::playPrev(bool fromUser)
                     if (_last - 1 < 0) {
                         _last = count();
                     }
-                    _engine->waitLastEnd();
+                    _engine->endLastPlayback();
                     _current = _last - 1;
                     _last = _current;
                     tryPlayCurrent(false);
@@ -734,7 +983,7 @@ void PlaylistModel::playPrev(bool fromUser)
             }
             _shufflePlayed--;
             qDebug() << "shuffle prev " << _shufflePlayed-1;
-            _engine->waitLastEnd();
+            _engine->endLastPlayback();
             _last = _current = _playOrder[_shufflePlayed-1];
             tryPlayCurrent(false);
             break;
@@ -746,7 +995,7 @@ void PlaylistModel::playPrev(bool fromUser)
                 _last = count()-1;
             }
 
-            _engine->waitLastEnd();
+            _engine->endLastPlayback();
             _current = _last;
             tryPlayCurrent(false);
             break;
@@ -758,7 +1007,7 @@ void PlaylistModel::playPrev(bool fromUser)
                 _last = count()-1;
             }
 
-            _engine->waitLastEnd();
+            _engine->endLastPlayback();
             _current = _last;
             tryPlayCurrent(false);
             break;
@@ -783,7 +1032,7 @@ void PlaylistModel::appendSingle(const QUrl& url)
         if (!fi.exists()) return;
         auto pif = calculatePlayInfo(url, fi);
         if (!pif.valid) return;
-        _infos.append(pif);
+        appendItem(pif);
 
 #ifndef _LIBDMR_
         if (Settings::get().isSet(Settings::AutoSearchSimilar)) {
@@ -793,14 +1042,14 @@ void PlaylistModel::appendSingle(const QUrl& url)
                 auto url = QUrl::fromLocalFile(fi.absoluteFilePath());
                 if (indexOf(url) < 0 && _engine->isPlayableFile(fi.fileName())) {
                     auto pif = calculatePlayInfo(url, fi);
-                    if (pif.valid) _infos.append(pif);
+                    if (pif.valid) appendItem(pif);
                 }
             });
         }
 #endif
     } else {
         auto pif = calculatePlayInfo(url, QFileInfo());
-        _infos.append(pif);
+        appendItem(pif);
     }
 }
 
@@ -847,39 +1096,28 @@ void PlaylistModel::appendAsync(const QList<QUrl>& urls)
 
 void PlaylistModel::delayedAppendAsync(const QList<QUrl>& urls)
 {
-    if (_pendingJob.size() > 0) {
-        //TODO: may be automatically schedule later
-        qWarning() << "there is a pending append going on, enqueue";
+    if (_pendingJob.size() > 0 && _firstLoad) {
+        // the restoring job keeps invalid items, do not mix user requests into it
+        qWarning() << "playlist is being loaded, enqueue";
         _pendingAppendReq.enqueue(urls);
         return;
     }
 
+    // a request coming while a job is running gets merged into that job
+    auto from = _pendingJob.size();
     collectionJob(urls);
-    if (!_pendingJob.size()) return;
 
-    struct MapFunctor {
-        PlaylistModel *_model = 0;
-        using result_type = PlayItemInfo;
-        MapFunctor(PlaylistModel* model): _model(model) {}
+    for (int i = from; i < _pendingJob.size(); i++) {
+        auto a = _pendingJob[i];
+        _jobIndex.insert(a.first, i);
+        _jobRemaining++;
 
-        struct PlayItemInfo operator()(const AppendJob& a) {
+        auto prio = a.first == _userRequestedUrl ?
+            ProbeScheduler::User : ProbeScheduler::Normal;
+        _prober->schedule(MetaProbe, a.first, [=](const QAtomicInt& canceled) {
             qDebug() << "mapping " << a.first.fileName();
-            return _model->calculatePlayInfo(a.first, a.second);
-        };
-    };
-
-    if (QThread::idealThreadCount() > 1) {
-        auto future = QtConcurrent::mapped(_pendingJob, MapFunctor(this));
-        _jobWatcher->setFuture(future);
-    } else {
-        PlayItemInfoList pil;
-        for (const auto& a: _pendingJob) {
-            qDebug() << "sync mapping " << a.first.fileName();
-            pil.append(calculatePlayInfo(a.first, a.second));
-        }
-        _pendingJob.clear();
-        _urlsInJob.clear();
-        handleAsyncAppendResults(pil);
+            return QVariant::fromValue(calculatePlayInfo(a.first, a.second, &canceled));
+        }, prio);
     }
 }
 
@@ -908,48 +1146,169 @@ static QList<PlayItemInfo>& SortSimilarFiles(QList<PlayItemInfo>& fil)
     return fil;
 }
 
-void PlaylistModel::onAsyncAppendFinished()
+void PlaylistModel::setAppendBatchSize(int sz)
 {
-    qDebug() << __func__;
-    auto f = _jobWatcher->future();
-    _pendingJob.clear();
-    _urlsInJob.clear();
+    _appendBatchSize = qMax(1, sz);
+}
 
-    auto fil = f.results();
-    handleAsyncAppendResults(fil);
+void PlaylistModel::prioritize(const QUrl& url)
+{
+    _userRequestedUrl = url;
+    _prober->boost(MetaProbe, url, ProbeScheduler::User);
+}
+
+void PlaylistModel::setVisibleRows(int first, int last)
+{
+    first = qMax(first, 0);
+    last = qMin(last, count() - 1);
+
+    // rows scrolled out of view do not need their thumbnails anymore
+    for (int i = qMax(_visibleFirst, 0); i <= _visibleLast && i < count(); i++) {
+        if (i < first || i > last) {
+            _prober->cancel(ThumbProbe, _infos[i].url);
+        }
+    }
+
+    _visibleFirst = first;
+    _visibleLast = last;
+    for (int i = first; i <= last; i++) {
+        if (!_thumbs.contains(_infos[i].url)) {
+            requestThumbnail(_infos[i], ProbeScheduler::Visible);
+        }
+    }
+}
+
+void PlaylistModel::onProbeFinished(int kind, const QUrl& url, const QVariant& result, int priority)
+{
+    if (kind == RevalidateProbe) {
+        auto id = indexOf(url);
+        if (id < 0 || !result.isValid()) return;
+
+        // changed since it was saved
+        auto pif = result.value<PlayItemInfo>();
+        _infos[id] = pif;
+        _thumbs.remove(url);
+        _thumbFailed.remove(url);
+        _journal->recordUpdate(pif);
+        emit itemInfoUpdated(id);
+        return;
+    }
+
+    if (kind == ThumbProbe) {
+        auto id = indexOf(url);
+        auto img = result.value<QImage>();
+        if (id < 0) return;
+        if (img.isNull()) {
+            _thumbFailed.insert(url);
+            return;
+        }
+
+        cacheThumbnail(url, img);
+        emit itemInfoUpdated(id);
+        return;
+    }
+
+    auto idx = _jobIndex.value(url, -1);
+    if (idx < 0) return;
+
+    auto pif = result.value<PlayItemInfo>();
+    if (priority == ProbeScheduler::User) {
+        // someone is waiting to play it, do not let it wait for its turn
+        _userRequestedUrl = QUrl();
+        _jobSkipped.insert(idx);
+        QList<PlayItemInfo> pil {pif};
+        handleAsyncAppendResults(pil);
+    } else {
+        _jobResults.insert(idx, pif);
+    }
+
+    if (--_jobRemaining == 0) {
+        finishAsyncAppend();
+    } else {
+        publishReadyResults(false);
+    }
+}
+
+// results get ready out of order, only the in-order prefix is published so
+// the playlist keeps the order of the request
+void PlaylistModel::publishReadyResults(bool finished)
+{
+    while (_jobCursor < _pendingJob.size()) {
+        if (_jobResults.contains(_jobCursor)) {
+            _jobBatch.append(_jobResults.take(_jobCursor));
+        } else if (!_jobSkipped.remove(_jobCursor)) {
+            break;
+        }
+        _jobCursor++;
+    }
+
+    // nothing published yet: do not wait for a full batch, so that playback
+    // can start as soon as possible
+    bool first = _jobAppended.isEmpty();
+    if (_jobBatch.size() && (first || finished || _jobBatch.size() >= _appendBatchSize)) {
+        handleAsyncAppendResults(_jobBatch);
+        _jobBatch.clear();
+    }
 }
 
 void PlaylistModel::handleAsyncAppendResults(QList<PlayItemInfo>& fil)
 {
     qDebug() << __func__ << fil.size();
-    if (!_firstLoad) {
-        //since _infos are modified only at the same thread, the lock is not necessary
-        auto last = std::remove_if(fil.begin(), fil.end(), [](const PlayItemInfo& pif) {
-                return !pif.mi.valid;
-            });
-        fil.erase(last, fil.end());
-    }
+    //since _infos are modified only at the same thread, the lock is not necessary
+    QSet<QUrl> seen;
+    auto last = std::remove_if(fil.begin(), fil.end(), [&](const PlayItemInfo& pif) {
+            // items may have been appended synchronously while the job was running,
+            // or be in the batch twice
+            if ((!_firstLoad && !pif.mi.valid) || _urlIndex.contains(pif.url)
+                    || seen.contains(pif.url))
+                return true;
+            seen.insert(pif.url);
+            return false;
+        });
+    fil.erase(last, fil.end());
 
     qDebug() << "collected items" << fil.count();
     if (fil.size()) {
+        auto from = _infos.size();
         if (!_firstLoad)
             _infos += SortSimilarFiles(fil);
         else
             _infos += fil;
+        for (const auto& pif: fil) {
+            _journal->recordAppend(pif);
+        }
+        reindex(from);
         reshuffle();
-        _firstLoad = false;
-        emit itemsAppended();
+        emit itemsAppended(from, fil.size());
         emit countChanged();
+        emit asyncAppendProgress(fil);
+        _jobAppended += fil;
     }
+}
+
+void PlaylistModel::finishAsyncAppend()
+{
+    publishReadyResults(true);
+    _pendingJob.clear();
+    _urlsInJob.clear();
+    _jobIndex.clear();
+    _jobCursor = 0;
+    _jobSkipped.clear();
+
     _firstLoad = false;
+    if (_legacyImport) finishLegacyImport();
+    auto fil = _jobAppended;
+    _jobAppended.clear();
     emit asyncAppendFinished(fil);
 
-    QTimer::singleShot(0, [&]() {
-        if (_pendingAppendReq.size()) {
-            auto job = _pendingAppendReq.dequeue();
-            delayedAppendAsync(job);
+    if (_pendingAppendReq.size()) {
+        // coalesce all queued requests into one job
+        UrlList urls;
+        while (_pendingAppendReq.size()) {
+            urls += _pendingAppendReq.dequeue();
         }
-    });
+        QTimer::singleShot(0, [=]() { delayedAppendAsync(urls); });
+    }
 }
 
 bool PlaylistModel::hasPendingAppends()
@@ -962,9 +1321,10 @@ void PlaylistModel::append(const QUrl& url)
 {
     if (!url.isValid()) return;
 
+    auto from = count();
     appendSingle(url);
     reshuffle();
-    emit itemsAppended();
+    emit itemsAppended(from, count() - from);
     emit countChanged();
 }
 
@@ -974,7 +1334,7 @@ void PlaylistModel::changeCurrent(int pos)
 
     _userRequestingItem = true;
 
-    _engine->waitLastEnd();
+    _engine->endLastPlayback();
     _current = pos;
     _last = _current;
     tryPlayCurrent(true);
@@ -986,6 +1346,8 @@ void PlaylistModel::switchPosition(int src, int target)
     //Q_ASSERT_X(0, "playlist", "not implemented");
     Q_ASSERT (src < _infos.size() && target < _infos.size());
     _infos.move(src, target);
+    reindex(qMin(src, target), qMax(src, target));
+    _journal->recordMove(_infos[target].url, target);
 
     int min = qMin(src, target);
     int max = qMax(src, target);
@@ -1034,10 +1396,13 @@ int PlaylistModel::current() const
     return _current;
 }
 
-struct PlayItemInfo PlaylistModel::calculatePlayInfo(const QUrl& url, const QFileInfo& fi)
+struct PlayItemInfo PlaylistModel::calculatePlayInfo(const QUrl& url, const QFileInfo& fi,
+        const QAtomicInt *canceled)
 {
     bool ok = false;
     struct MovieInfo mi;
+    // taken before probing, a file changed meanwhile is probed again later
+    auto id = fileIdentity(url);
 
     auto ci = PersistentManager::get().loadFromCache(url);
     if (ci.mi_valid) {
@@ -1045,7 +1410,7 @@ struct PlayItemInfo PlaylistModel::calculatePlayInfo(const QUrl& url, const QFil
         ok = true;
         qDebug() << "load cached MovieInfo" << mi;
     } else {
-        mi = MovieInfo::parseFromFile(fi, &ok);
+        mi = MovieInfo::parseFromFile(fi, &ok, MovieInfo::QuickProbe, canceled);
         if (url.scheme().startsWith("dvd")) {
             QString dev = url.path();
             if (dev.isEmpty()) dev = "/dev/sr0";
@@ -1064,39 +1429,142 @@ struct PlayItemInfo PlaylistModel::calculatePlayInfo(const QUrl& url, const QFil
         }
     }
 
-    QPixmap pm;
-    if (ci.thumb_valid) {
-        pm = ci.thumb;
-        qDebug() << "load cached thumb" << url;
-    } else if (ok) {
-        try {
-            std::vector<uint8_t> buf;
-            _thumbnailer.generateThumbnail(fi.canonicalFilePath().toUtf8().toStdString(),
-                    ThumbnailerImageType::Png, buf);
-
-            auto img = QImage::fromData(buf.data(), buf.size(), "png");
-            pm = QPixmap::fromImage(img);
-            pm.setDevicePixelRatio(qApp->devicePixelRatio());
-        } catch (const std::logic_error&) {
-        }
+    // thumbnail is loaded on demand, see thumbnail()
+    PlayItemInfo pif { fi.exists() || !url.isLocalFile(), ok, url, fi, mi, id };
+    if (ok && url.isLocalFile() && !ci.mi_valid) {
+        PersistentManager::get().saveInfo(url, mi);
     }
 
-    PlayItemInfo pif { fi.exists() || !url.isLocalFile(), ok, url, fi, pm, mi };
-    if (ok && url.isLocalFile() && (!ci.mi_valid || !ci.thumb_valid)) {
-        PersistentManager::get().save(pif);
+    return pif;
+}
+
+QSize PlaylistModel::thumbnailSize(ThumbnailTier tier)
+{
+    return tier == PlaylistThumb ? QSize(22, 40) : QSize(176, 118);
+}
+
+// scale to cover sz and crop the center
+static QImage cropThumbnail(const QImage& img, const QSize& sz)
+{
+    auto scaled = img.scaled(sz, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
+    return scaled.copy((scaled.width() - sz.width()) / 2, (scaled.height() - sz.height()) / 2,
+            sz.width(), sz.height()).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
+
+QImage PlaylistModel::generateThumbnail(const QUrl& url, const QFileInfo& fi, qreal dpr,
+        ThumbnailTier tier, const QAtomicInt *canceled)
+{
+    // swscale writes the frame straight into a QImage covering the tier,
+    // only the crop is left to do
+    FrameDecoder decoder;
+    if (canceled) {
+        decoder.setInterruptCallback([=]() { return canceled->load() != 0; });
     }
+    if (!decoder.open(fi.canonicalFilePath())) return QImage();
 
-    return pif;
+    // where ffmpegthumbnailer used to take it, past most intros
+    auto frame = decoder.frameAt(decoder.duration() / 10, thumbnailSize(tier) * dpr,
+            Qt::KeepAspectRatioByExpanding);
+    if (frame.isNull()) return frame;
+
+    auto img = cropThumbnail(frame, thumbnailSize(tier) * dpr);
+    img.setDevicePixelRatio(dpr);
+    PersistentManager::get().saveThumb(url, tier, img);
+    return img;
+}
+
+void PlaylistModel::requestThumbnail(const PlayItemInfo& pif, int priority)
+{
+    if (!pif.mi.valid || !pif.url.isLocalFile() || _thumbFailed.contains(pif.url))
+        return;
+
+    auto url = pif.url;
+    auto fi = pif.info;
+    auto dpr = qApp->devicePixelRatio();
+    _prober->schedule(ThumbProbe, url, [=](const QAtomicInt& canceled) {
+        auto img = PersistentManager::get().loadThumb(url, PlaylistThumb);
+        // made for another scale factor, redo them
+        if (!img.isNull() && img.devicePixelRatio() == dpr) return QVariant(img);
+        if (canceled.load()) return QVariant(QImage());
+
+        return QVariant(generateThumbnail(url, fi, dpr, PlaylistThumb, &canceled));
+    }, (ProbeScheduler::Priority)priority);
+}
+
+QPixmap PlaylistModel::thumbnail(const QUrl& url)
+{
+    if (auto *pm = _thumbs.object(url)) {
+        return *pm;
+    }
+
+    // got evicted while still shown
+    auto id = indexOf(url);
+    if (id >= _visibleFirst && id <= _visibleLast) {
+        requestThumbnail(_infos[id], ProbeScheduler::Visible);
+    }
+    return QPixmap();
+}
+
+CacheStats PlaylistModel::cacheStats()
+{
+    return PersistentManager::get().stats();
+}
+
+QPixmap PlaylistModel::loadThumbnail(const QUrl& url)
+{
+    // few posters are ever looked at, so they're made on first demand
+    // instead of for every item
+    auto dpr = qApp->devicePixelRatio();
+    auto img = PersistentManager::get().loadThumb(url, PosterThumb);
+    if ((img.isNull() || img.devicePixelRatio() != dpr) && url.isLocalFile()
+            && !_thumbFailed.contains(url)) {
+        img = generateThumbnail(url, QFileInfo(url.toLocalFile()), dpr, PosterThumb);
+    }
+    return QPixmap::fromImage(img);
+}
+
+QPixmap PlaylistModel::cacheThumbnail(const QUrl& url, const QImage& img)
+{
+    auto pm = QPixmap::fromImage(img);
+    pm.setDevicePixelRatio(img.devicePixelRatio());
+    _thumbs.insert(url, new QPixmap(pm), pm.width() * pm.height() * pm.depth() / 8);
+    return pm;
+}
+
+void PlaylistModel::setThumbnailBudget(int bytes)
+{
+    _thumbs.setMaxCost(qMax(bytes, 0));
+}
+
+int PlaylistModel::thumbnailBudget() const
+{
+    return _thumbs.maxCost();
+}
+
+int PlaylistModel::residentThumbnailBytes() const
+{
+    return _thumbs.totalCost();
 }
 
 int PlaylistModel::indexOf(const QUrl& url)
 {
-    auto p = std::find_if(_infos.begin(), _infos.end(), [&](const PlayItemInfo& pif) {
-        return pif.url == url;
-    });
+    return _urlIndex.value(url, -1);
+}
+
+void PlaylistModel::appendItem(const PlayItemInfo& pif)
+{
+    _infos.append(pif);
+    _urlIndex.insert(pif.url, _infos.size() - 1);
+    _journal->recordAppend(pif);
+}
 
-    if (p == _infos.end()) return -1;
-    return std::distance(_infos.begin(), p);
+// refresh url -> row mapping for rows in [from, to], to < 0 means till the end
+void PlaylistModel::reindex(int from, int to)
+{
+    if (to < 0 || to >= _infos.size()) to = _infos.size() - 1;
+    for (int i = from; i <= to; ++i) {
+        _urlIndex[_infos[i].url] = i;
+    }
 }
 
 }
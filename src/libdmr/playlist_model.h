@@ -32,13 +32,13 @@
 
 #include <QtWidgets>
 #include <QtConcurrent>
-#include <libffmpegthumbnailer/videothumbnailer.h>
 
 #include "utils.h"
 
 namespace dmr {
-using namespace ffmpegthumbnailer;
 class PlayerEngine;
+class ProbeScheduler;
+class PlaylistJournal;
 
 struct MovieInfo {
     bool valid;
@@ -54,7 +54,14 @@ struct MovieInfo {
     qint64 duration;
     int width, height;
 
-    static struct MovieInfo parseFromFile(const QFileInfo& fi, bool *ok = nullptr);
+    enum ProbeMode {
+        FullProbe,   // read and decode packets until every stream is known
+        QuickProbe,  // trust container headers, capped probing budget, and
+                     // fall back to a full probe when that's inconclusive
+    };
+    // gives up as soon as canceled becomes non-zero
+    static struct MovieInfo parseFromFile(const QFileInfo& fi, bool *ok = nullptr,
+            ProbeMode mode = FullProbe, const QAtomicInt *canceled = nullptr);
     QString durationStr() const {
         return utils::Time2str(duration);
     }
@@ -75,17 +82,46 @@ struct MovieInfo {
 };
 
 
+QDataStream& operator<< (QDataStream& st, const MovieInfo& mi);
+QDataStream& operator>> (QDataStream& st, MovieInfo& mi);
+
+// cheap stat based identity of a local file, all zero for anything else.
+// cached or journaled movie info is only valid for the identity it was
+// computed from
+struct FileIdentity {
+    quint64 dev;
+    quint64 ino;
+    quint64 size;
+    quint64 mtime_ns;
+
+    bool operator==(const FileIdentity& o) const {
+        return dev == o.dev && ino == o.ino && size == o.size && mtime_ns == o.mtime_ns;
+    }
+    bool operator!=(const FileIdentity& o) const { return !(*this == o); }
+};
+
+FileIdentity fileIdentity(const QUrl& url);
+
 struct PlayItemInfo {
     bool valid;
     bool loaded;  // if url is network, this is false until playback started
     QUrl url;
     QFileInfo info;
-    QPixmap thumbnail;
     struct MovieInfo mi;
+    FileIdentity id;  // of the file mi was probed from
 
     bool refresh();
 };
 
+// counters of the persistent movie info and thumbnail cache
+struct CacheStats {
+    int hits;
+    int misses;
+    int stale;      // found, but the file has changed since
+    int collected;  // dropped by gc
+    qint64 fileSize;
+};
+
 using AppendJob = QPair<QUrl, QFileInfo>; // async job
 using PlayItemInfoList = QList<PlayItemInfo>;
 using UrlList = QList<QUrl>;
@@ -122,6 +158,9 @@ public:
 
     void playNext(bool fromUser);
     void playPrev(bool fromUser);
+    // item the end of current one leads to, -1 if it stops, repeats or
+    // can't be known yet (next shuffle round)
+    int predictNext() const;
 
     int count() const;
     const QList<PlayItemInfo>& items() const { return _infos; }
@@ -130,26 +169,63 @@ public:
     int current() const;
     const PlayItemInfo& currentInfo() const;
     PlayItemInfo& currentInfo();
+    // O(1), backed by _urlIndex
     int indexOf(const QUrl& url);
 
     void switchPosition(int p1, int p2);
 
     bool hasPendingAppends();
 
+    // async append results are published in batches of at most this many items
+    int appendBatchSize() const { return _appendBatchSize; }
+    void setAppendBatchSize(int sz);
+
+    // probe url (which is being appended) ahead of anything else
+    void prioritize(const QUrl& url);
+    // rows currently shown by ui, their thumbnails get loaded
+    void setVisibleRows(int first, int last);
+
+    // thumbnails are made once in the exact sizes they are shown at, and
+    // stored as raw pixels, so nothing is decoded or scaled when painting
+    enum ThumbnailTier {
+        PlaylistThumb,  // crop in playlist rows
+        PosterThumb,    // cover of movie info dialog
+    };
+    // in device independent pixels
+    static QSize thumbnailSize(ThumbnailTier tier);
+
+    // Playlist thumbnails are kept in a lru store bounded by a budget in
+    // bytes, and (re)loaded from disk cache for visible rows.
+    // returns a null pixmap when not resident, itemInfoUpdated is emitted
+    // once it's loaded.
+    QPixmap thumbnail(const QUrl& url);
+    // blocks to load the poster from disk cache, or to make it the first
+    // time it's asked for
+    QPixmap loadThumbnail(const QUrl& url);
+    int thumbnailBudget() const;
+    void setThumbnailBudget(int bytes);
+    int residentThumbnailBytes() const;
+
+    static CacheStats cacheStats();
+
 public slots:
     void changeCurrent(int);
 
 private slots:
-    void onAsyncAppendFinished();
+    void onProbeFinished(int kind, const QUrl& url, const QVariant& result, int priority);
     void delayedAppendAsync(const QList<QUrl>&);
 
 signals:
     void countChanged();
     void currentChanged();
     void itemRemoved(int);
-    void itemsAppended();
+    // rows [from, from + count) are newly appended
+    void itemsAppended(int from, int count);
     void emptied();
     void playModeChanged(PlayMode);
+    // emitted for each batch of an async append as soon as it lands in the list
+    void asyncAppendProgress(const QList<PlayItemInfo>&);
+    // all items appended by the async job
     void asyncAppendFinished(const QList<PlayItemInfo>&);
     void itemInfoUpdated(int id);
 
@@ -161,6 +237,7 @@ private:
     int _last {-1};
     PlayMode _playMode {PlayMode::OrderPlay};
     QList<PlayItemInfo> _infos;
+    QHash<QUrl, int> _urlIndex; // url -> row in _infos, kept in sync with _infos
 
     QList<int> _playOrder; // for shuffle mode
     int _shufflePlayed {0}; // count currently played items in shuffle mode
@@ -168,28 +245,57 @@ private:
 
     QList<AppendJob> _pendingJob; // async job
     QSet<QString> _urlsInJob;  // url list
-    QFutureWatcher<PlayItemInfo> *_jobWatcher {nullptr};
+    QHash<QUrl, int> _jobIndex; // url -> index in _pendingJob
+    int _jobRemaining {0}; // probes of current job not finished yet
+    int _jobCursor {0}; // next job result to publish, results are published in order
+    QHash<int, PlayItemInfo> _jobResults; // probed, waiting for its turn
+    QSet<int> _jobSkipped; // published out of order
+    QList<PlayItemInfo> _jobBatch; // ready but not yet published
+    QList<PlayItemInfo> _jobAppended; // published by current job
+    int _appendBatchSize {32};
 
     QQueue<UrlList> _pendingAppendReq;
 
+    ProbeScheduler *_prober {nullptr};
+    QUrl _userRequestedUrl;
+
+    QCache<QUrl, QPixmap> _thumbs; // cost in bytes
+    QSet<QUrl> _thumbFailed; // do not try again
+    int _visibleFirst {-1};
+    int _visibleLast {-1};
+
     bool _userRequestingItem {false};
 
-    VideoThumbnailer _thumbnailer;
     PlayerEngine *_engine {nullptr};
 
-    QString _playlistFile;
-
-    struct PlayItemInfo calculatePlayInfo(const QUrl&, const QFileInfo& fi);
+    QString _playlistFile; // legacy QSettings playlist
+    bool _legacyImport {false}; // _playlistFile is being appended
+    PlaylistJournal *_journal {nullptr};
+
+    struct PlayItemInfo calculatePlayInfo(const QUrl&, const QFileInfo& fi,
+            const QAtomicInt *canceled = nullptr);
+    // makes and stores the thumbnail of tier
+    QImage generateThumbnail(const QUrl& url, const QFileInfo& fi, qreal dpr,
+            ThumbnailTier tier, const QAtomicInt *canceled = nullptr);
+    void requestThumbnail(const PlayItemInfo& pif, int priority);
+    QPixmap cacheThumbnail(const QUrl& url, const QImage& img);
     void reshuffle();
-    void savePlaylist();
     void loadPlaylist();
-    void clearPlaylist();
+    void loadLegacyPlaylist();
+    void finishLegacyImport();
+    void requestRevalidation(const QUrl& url, const FileIdentity& id);
     void appendSingle(const QUrl&);
     void tryPlayCurrent(bool next);
+    void appendItem(const PlayItemInfo& pif);
+    void reindex(int from, int to = -1);
+    void publishReadyResults(bool finished);
     void handleAsyncAppendResults(QList<PlayItemInfo>& pil);
+    void finishAsyncAppend();
 };
 
 }
 
+Q_DECLARE_METATYPE(dmr::PlayItemInfo)
+
 #endif /* ifndef _DMR_PLAYLIST_MODEL_H */
 
@@ -0,0 +1,197 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include "probe_scheduler.h"
+
+namespace dmr {
+
+class ProbeRunnable: public QRunnable {
+public:
+    ProbeRunnable(ProbeScheduler *s, int id, ProbeScheduler::Work w,
+            QSharedPointer<QAtomicInt> canceled)
+        :_sched(s), _id(id), _work(w), _canceled(canceled) {}
+
+    void run() override
+    {
+        // probing should never compete with playback
+        QThread::currentThread()->setPriority(QThread::LowPriority);
+
+        QVariant v;
+        if (!_canceled->load()) {
+            v = _work(*_canceled);
+        }
+        _sched->reportResult(_id, v);
+    }
+
+private:
+    ProbeScheduler *_sched {nullptr};
+    int _id;
+    ProbeScheduler::Work _work;
+    QSharedPointer<QAtomicInt> _canceled;
+};
+
+ProbeScheduler::ProbeScheduler(QObject *parent)
+    :QObject(parent)
+{
+    // leave a core for ui and playback
+    setMaxParallel(QThread::idealThreadCount() - 1);
+}
+
+ProbeScheduler::~ProbeScheduler()
+{
+    cancelAll();
+    _pool.waitForDone();
+}
+
+void ProbeScheduler::setMaxParallel(int n)
+{
+    _pool.setMaxThreadCount(qMax(1, n));
+    dispatch();
+}
+
+void ProbeScheduler::schedule(int kind, const QUrl& url, Work work, Priority p)
+{
+    auto key = qMakePair(kind, url);
+    if (_keys.contains(key)) {
+        boost(kind, url, p);
+        return;
+    }
+
+    Job job;
+    job.id = _nextId++;
+    job.kind = kind;
+    job.url = url;
+    job.prio = p;
+    job.work = work;
+    job.canceled = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+    _jobs.insert(job.id, job);
+    _keys.insert(key, job.id);
+    _queues[p].enqueue(job.id);
+    dispatch();
+}
+
+void ProbeScheduler::boost(int kind, const QUrl& url, Priority p)
+{
+    auto id = _keys.value(qMakePair(kind, url), -1);
+    if (id < 0) return;
+
+    auto& job = _jobs[id];
+    if (job.running || job.prio >= p) return;
+
+    job.prio = p;
+    _queues[p].enqueue(id);
+}
+
+void ProbeScheduler::cancel(int kind, const QUrl& url)
+{
+    auto key = qMakePair(kind, url);
+    if (!_keys.contains(key)) return;
+
+    auto id = _keys.take(key);
+    auto p = _jobs.find(id);
+    if (p == _jobs.end()) return;
+
+    p->canceled->store(1);
+    _jobs.erase(p);
+}
+
+void ProbeScheduler::cancelAll()
+{
+    for (auto& job: _jobs) {
+        job.canceled->store(1);
+    }
+    _jobs.clear();
+    _keys.clear();
+    for (auto& q: _queues) {
+        q.clear();
+    }
+}
+
+int ProbeScheduler::takeNext()
+{
+    for (int p = User; p >= Normal; p--) {
+        auto& q = _queues[p];
+        while (!q.isEmpty()) {
+            auto id = q.dequeue();
+            auto i = _jobs.find(id);
+            if (i != _jobs.end() && !i->running && i->prio == p) {
+                return id;
+            }
+        }
+    }
+
+    return -1;
+}
+
+void ProbeScheduler::dispatch()
+{
+    while (_running < _pool.maxThreadCount()) {
+        auto id = takeNext();
+        if (id < 0) break;
+
+        auto& job = _jobs[id];
+        job.running = true;
+        _running++;
+        _pool.start(new ProbeRunnable(this, id, job.work, job.canceled));
+    }
+}
+
+// called from worker threads
+void ProbeScheduler::reportResult(int id, const QVariant& v)
+{
+    {
+        QMutexLocker lock(&_resultLock);
+        _results.insert(id, v);
+    }
+    QMetaObject::invokeMethod(this, "onJobDone", Qt::QueuedConnection, Q_ARG(int, id));
+}
+
+void ProbeScheduler::onJobDone(int id)
+{
+    QVariant v;
+    {
+        QMutexLocker lock(&_resultLock);
+        v = _results.take(id);
+    }
+    _running--;
+
+    // a cancelled job has been removed already
+    auto p = _jobs.find(id);
+    if (p != _jobs.end()) {
+        auto job = *p;
+        _jobs.erase(p);
+        _keys.remove(qMakePair(job.kind, job.url));
+        emit finished(job.kind, job.url, v, job.prio);
+    }
+
+    dispatch();
+}
+
+}
@@ -0,0 +1,110 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#ifndef _DMR_PROBE_SCHEDULER_H
+#define _DMR_PROBE_SCHEDULER_H 
+
+#include <QtCore>
+#include <functional>
+
+namespace dmr {
+
+/* Runs media probing jobs (movie info, thumbnails) on a private bounded thread
+ * pool. A job is identified by (kind, url), jobs with higher priority run first,
+ * and queued jobs can be boosted or cancelled at any time.
+ * The scheduler should only be used from the thread it lives in.
+ */
+class ProbeScheduler: public QObject {
+    Q_OBJECT
+public:
+    enum Priority {
+        Normal,
+        Visible, // item is shown by ui
+        User,    // item is requested by user
+    };
+
+    // executed on a worker thread, should bail out when canceled becomes non-zero
+    using Work = std::function<QVariant (const QAtomicInt& canceled)>;
+
+    ProbeScheduler(QObject *parent = nullptr);
+    ~ProbeScheduler();
+
+    int maxParallel() const { return _pool.maxThreadCount(); }
+    void setMaxParallel(int n);
+
+    // scheduling a job which is already queued only raises its priority
+    void schedule(int kind, const QUrl& url, Work work, Priority p = Normal);
+    void boost(int kind, const QUrl& url, Priority p);
+
+    // queued jobs are dropped, running ones get signaled to abort, none of
+    // them will be reported
+    void cancel(int kind, const QUrl& url);
+    void cancelAll();
+
+    // queued and running jobs
+    int pendingCount() const { return _jobs.size(); }
+
+signals:
+    void finished(int kind, const QUrl& url, const QVariant& result, int priority);
+
+private slots:
+    void onJobDone(int id);
+
+private:
+    friend class ProbeRunnable;
+    struct Job {
+        int id {-1};
+        int kind {0};
+        QUrl url;
+        Priority prio {Normal};
+        Work work;
+        QSharedPointer<QAtomicInt> canceled;
+        bool running {false};
+    };
+
+    QThreadPool _pool;
+    int _nextId {0};
+    int _running {0};
+    QHash<int, Job> _jobs;
+    QHash<QPair<int, QUrl>, int> _keys;
+    // one fifo per priority, entries of boosted or cancelled jobs are left
+    // behind and skipped when dequeued
+    QQueue<int> _queues[User + 1];
+
+    QMutex _resultLock;
+    QHash<int, QVariant> _results; // filled by workers
+
+    void dispatch();
+    int takeNext();
+    void reportResult(int id, const QVariant& v);
+};
+
+}
+
+#endif /* ifndef _DMR_PROBE_SCHEDULER_H */
@@ -346,9 +346,19 @@ void MoveToCenter(QWidget* w)
 
 QString Time2str(qint64 seconds)
 {
-    QTime d(0, 0, 0);
-    d = d.addSecs(seconds);
-    return d.toString("hh:mm:ss");
+    // hh:mm:ss wrapped at a day like QTime does, but without parsing a
+    // format string each time. called for every elapsed second
+    seconds %= 86400;
+    if (seconds < 0) seconds += 86400;
+
+    int parts[3] = {int(seconds / 3600), int(seconds / 60 % 60), int(seconds % 60)};
+    QChar buf[8];
+    for (int i = 0; i < 3; i++) {
+        buf[i * 3] = QLatin1Char('0' + parts[i] / 10);
+        buf[i * 3 + 1] = QLatin1Char('0' + parts[i] % 10);
+        if (i < 2) buf[i * 3 + 2] = QLatin1Char(':');
+    }
+    return QString(buf, 8);
 }
 
 bool ValidateScreenshotPath(const QString& path)
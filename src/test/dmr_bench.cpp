@@ -0,0 +1,785 @@
+/* 
+ * (c) 2017, Deepin Technology Co., Ltd. <support@deepin.org>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+ */
+#include <player_engine.h>
+#include <playlist_model.h>
+#include <playlist_journal.h>
+#include <frame_decoder.h>
+#include <utils.h>
+#include <mpv_proxy.h>
+#include <mpv/client.h>
+#include <QtWidgets>
+#include <libffmpegthumbnailer/videothumbnailer.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+
+// synthetic network urls skip probing and thumbnailing, so what gets measured
+// is playlist bookkeeping (duplicate lookup and indexing) only.
+static QList<QUrl> makeUrls(int n)
+{
+    QList<QUrl> urls;
+    urls.reserve(n);
+    for (int i = 0; i < n; i++) {
+        urls.append(QUrl(QString("http://dmr-bench.invalid/%1.mp4").arg(i)));
+    }
+    return urls;
+}
+
+// a short clip of flat, slowly changing frames encoded with mpeg4, which
+// every ffmpeg build has. container is picked from the suffix of path
+static bool writeClip(const QString& path, int w, int h, int frames, int gop = 5, int fps = 10)
+{
+    auto fn = path.toUtf8();
+    AVFormatContext *oc = NULL;
+    AVCodecContext *enc = NULL;
+    AVStream *st = NULL;
+    AVFrame *frame = NULL;
+    AVPacket *pkt = NULL;
+    bool ok = false;
+
+    auto *codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    if (!codec || avformat_alloc_output_context2(&oc, NULL, NULL, fn.constData()) < 0)
+        return false;
+
+    st = avformat_new_stream(oc, NULL);
+    enc = avcodec_alloc_context3(codec);
+    if (!st || !enc) goto out;
+
+    enc->width = w;
+    enc->height = h;
+    enc->time_base = AVRational {1, fps};
+    enc->framerate = AVRational {fps, 1};
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->gop_size = gop;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    if (avcodec_open2(enc, codec, NULL) < 0) goto out;
+
+    avcodec_parameters_from_context(st->codecpar, enc);
+    st->time_base = enc->time_base;
+    if (avio_open(&oc->pb, fn.constData(), AVIO_FLAG_WRITE) < 0) goto out;
+    if (avformat_write_header(oc, NULL) < 0) goto out;
+
+    frame = av_frame_alloc();
+    pkt = av_packet_alloc();
+    if (!frame || !pkt) goto out;
+    frame->format = enc->pix_fmt;
+    frame->width = w;
+    frame->height = h;
+    if (av_frame_get_buffer(frame, 0) < 0) goto out;
+
+    // one extra round to drain the encoder
+    for (int i = 0; i <= frames; i++) {
+        AVFrame *f = NULL;
+        if (i < frames) {
+            av_frame_make_writable(frame);
+            for (int y = 0; y < h; y++)
+                memset(frame->data[0] + y * frame->linesize[0], (i * 8 + y) & 0xff, w);
+            for (int y = 0; y < h / 2; y++) {
+                memset(frame->data[1] + y * frame->linesize[1], 128, w / 2);
+                memset(frame->data[2] + y * frame->linesize[2], 128, w / 2);
+            }
+            frame->pts = i;
+            f = frame;
+        }
+
+        if (avcodec_send_frame(enc, f) < 0) goto out;
+        while (avcodec_receive_packet(enc, pkt) == 0) {
+            av_packet_rescale_ts(pkt, enc->time_base, st->time_base);
+            pkt->stream_index = st->index;
+            av_interleaved_write_frame(oc, pkt);
+        }
+    }
+    ok = av_write_trailer(oc) == 0;
+
+out:
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    if (oc->pb) avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    return ok;
+}
+
+// mp4 and mkv take the header only probe path, avi does not
+static QStringList makeCorpus(const QString& dir, int n)
+{
+    static const char *suffixes[] = {"mp4", "mkv", "avi"};
+
+    QStringList files;
+    for (int i = 0; i < n; i++) {
+        auto path = QString("%1/clip-%2.%3").arg(dir).arg(i, 4, 10, QChar('0'))
+            .arg(suffixes[i % 3]);
+        if (writeClip(path, 320, 180, 20)) {
+            files.append(path);
+        } else {
+            qWarning() << "failed to generate" << path;
+        }
+    }
+    return files;
+}
+
+static QJsonObject percentiles(QVector<qint64> ns)
+{
+    if (ns.isEmpty()) return QJsonObject();
+
+    std::sort(ns.begin(), ns.end());
+    auto at = [&](double p) { return ns[qMin(ns.size() - 1, (int)(p * ns.size()))] / 1e6; };
+    return QJsonObject {
+        {"p50_ms", at(0.5)},
+        {"p90_ms", at(0.9)},
+        {"p99_ms", at(0.99)},
+        {"max_ms", ns.last() / 1e6},
+    };
+}
+
+// seek bar previews at random positions of a longer clip: reopening the
+// file for every one (what ThumbnailWorker did with ffmpegthumbnailer)
+// against a FrameDecoder kept open
+static QJsonObject benchPreview(const QString& dir)
+{
+    auto path = dir + "/preview.mkv";
+    // 2 minutes at 10 fps, keyframes every 5 secs
+    if (!writeClip(path, 640, 360, 1200, 50)) return QJsonObject();
+
+    const QSize sz(158, 89);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> dist(0, 119);
+    QVector<int> positions;
+    for (int i = 0; i < 100; i++) positions.append(dist(rng));
+
+    QVector<qint64> reopen, reuse;
+    {
+        using namespace ffmpegthumbnailer;
+        VideoThumbnailer thumber;
+        thumber.setThumbnailSize(sz.width());
+        thumber.setMaintainAspectRatio(true);
+        for (auto secs: positions) {
+            QElapsedTimer t;
+            t.start();
+            thumber.setSeekTime(QTime(0, 0, 0).addSecs(secs).toString("hh:mm:ss").toStdString());
+            std::vector<uint8_t> buf;
+            try {
+                thumber.generateThumbnail(path.toStdString(), ThumbnailerImageType::Png, buf);
+            } catch (const std::logic_error&) {
+            }
+            auto img = QImage::fromData(buf.data(), buf.size(), "png");
+            img = img.scaled(sz, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
+            reopen.append(t.nsecsElapsed());
+        }
+    }
+
+    {
+        dmr::FrameDecoder decoder;
+        decoder.open(path);
+        for (auto secs: positions) {
+            QElapsedTimer t;
+            t.start();
+            decoder.frameAt(secs * 1000LL, sz, Qt::KeepAspectRatioByExpanding);
+            reuse.append(t.nsecsElapsed());
+        }
+    }
+
+    auto a = percentiles(reopen), b = percentiles(reuse);
+    printf("preview %d positions: reopen p50 %.2f p90 %.2f p99 %.2f ms, "
+            "decoder reuse p50 %.2f p90 %.2f p99 %.2f ms\n", positions.size(),
+            a["p50_ms"].toDouble(), a["p90_ms"].toDouble(), a["p99_ms"].toDouble(),
+            b["p50_ms"].toDouble(), b["p90_ms"].toDouble(), b["p99_ms"].toDouble());
+
+    return QJsonObject {
+        {"positions", positions.size()},
+        {"reopen", a},
+        {"reuse", b},
+    };
+}
+
+// playlist thumbnails of every tier for each file: ffmpegthumbnailer
+// encoding an image that is decoded again (png as it used to be, then
+// jpeg), against libav and swscale writing into a QImage directly
+static QJsonObject benchThumbnail(const QStringList& files)
+{
+    using namespace ffmpegthumbnailer;
+    auto crop = [](const QImage& img, const QSize& sz) {
+        auto scaled = img.scaled(sz, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
+        return scaled.copy((scaled.width() - sz.width()) / 2, (scaled.height() - sz.height()) / 2,
+                sz.width(), sz.height()).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    };
+    auto tiers = [&](const QImage& frame) {
+        for (auto tier: {dmr::PlaylistModel::PlaylistThumb, dmr::PlaylistModel::PosterThumb}) {
+            crop(frame, dmr::PlaylistModel::thumbnailSize(tier));
+        }
+    };
+
+    QJsonObject ret;
+    struct { const char *name; ThumbnailerImageType type; const char *format; } codecs[] = {
+        {"png", ThumbnailerImageType::Png, "png"},
+        {"jpeg", ThumbnailerImageType::Jpeg, "jpg"},
+    };
+    for (const auto& c: codecs) {
+        VideoThumbnailer thumber;
+        thumber.setThumbnailSize(320);
+        QVector<qint64> ns;
+        for (const auto& f: files) {
+            QElapsedTimer t;
+            t.start();
+            std::vector<uint8_t> buf;
+            try {
+                thumber.generateThumbnail(f.toStdString(), c.type, buf);
+            } catch (const std::logic_error&) {
+            }
+            tiers(QImage::fromData(buf.data(), buf.size(), c.format));
+            ns.append(t.nsecsElapsed());
+        }
+        ret[c.name] = percentiles(ns);
+    }
+
+    QVector<qint64> ns;
+    for (const auto& f: files) {
+        QElapsedTimer t;
+        t.start();
+        dmr::FrameDecoder decoder;
+        if (decoder.open(f)) {
+            tiers(decoder.frameAt(decoder.duration() / 10,
+                        dmr::PlaylistModel::thumbnailSize(dmr::PlaylistModel::PosterThumb),
+                        Qt::KeepAspectRatioByExpanding));
+        }
+        ns.append(t.nsecsElapsed());
+    }
+    ret["direct"] = percentiles(ns);
+
+    auto p50 = [&](const char *k) { return ret[k].toObject()["p50_ms"].toDouble(); };
+    printf("thumbnail %d files p50: png %.2f ms, jpeg %.2f ms, direct %.2f ms (%.1fx over png)\n",
+            files.size(), p50("png"), p50("jpeg"), p50("direct"),
+            p50("direct") > 0 ? p50("png") / p50("direct") : 0.0);
+    ret["files"] = files.size();
+    return ret;
+}
+
+// screenshot-raw of a 4k frame: copied out of mpv's node with a QString per
+// key, as MpvProxy used to, against handing the node over to the QImage.
+// convert is the part after mpv_command_ret returned
+static QJsonObject benchScreenshot(const QString& dir)
+{
+    auto path = dir + "/shot.mkv";
+    if (!writeClip(path, 3840, 2160, 10)) return QJsonObject();
+
+    mpv_handle *h = mpv_create();
+    mpv_set_option_string(h, "vo", "null");
+    mpv_set_option_string(h, "ao", "null");
+    mpv_set_option_string(h, "pause", "yes");
+    if (mpv_initialize(h) < 0) {
+        mpv_terminate_destroy(h);
+        return QJsonObject();
+    }
+
+    auto file = path.toUtf8();
+    const char *load[] = {"loadfile", file.constData(), NULL};
+    mpv_command(h, load);
+    bool ready = false;
+    while (!ready) {
+        auto *ev = mpv_wait_event(h, 10);
+        if (ev->event_id == MPV_EVENT_NONE || ev->event_id == MPV_EVENT_END_FILE) break;
+        ready = ev->event_id == MPV_EVENT_PLAYBACK_RESTART;
+    }
+
+    QVector<qint64> copyTotal, copyConvert, handTotal, handConvert;
+    const char *shot[] = {"screenshot-raw", NULL};
+    for (int i = 0; ready && i < 20; i++) {
+        for (int handover = 0; handover < 2; handover++) {
+            QElapsedTimer t;
+            t.start();
+            mpv_node res;
+            if (mpv_command_ret(h, shot, &res) < 0) {
+                ready = false;
+                break;
+            }
+            auto got = t.nsecsElapsed();
+
+            QImage img;
+            if (handover) {
+                img = dmr::MpvProxy::imageFromScreenshot(&res);
+            } else {
+                int w = 0, hh = 0, stride = 0;
+                uchar *data = NULL;
+                mpv_node_list *list = res.u.list;
+                for (int n = 0; n < list->num; n++) {
+                    auto key = QString::fromUtf8(list->keys[n]);
+                    if (key == "w") w = list->values[n].u.int64;
+                    else if (key == "h") hh = list->values[n].u.int64;
+                    else if (key == "stride") stride = list->values[n].u.int64;
+                    else if (key == "data") data = (uchar*)list->values[n].u.ba->data;
+                }
+                if (data) {
+                    img = QImage((const uchar*)data, w, hh, stride, QImage::Format_RGB32);
+                    img.bits();
+                }
+                mpv_free_node_contents(&res);
+            }
+            auto total = t.nsecsElapsed();
+            if (img.isNull()) {
+                ready = false;
+                break;
+            }
+            (handover ? handTotal : copyTotal).append(total);
+            (handover ? handConvert : copyConvert).append(total - got);
+        }
+    }
+    mpv_terminate_destroy(h);
+
+    // e.g the null vo of an old mpv can't take screenshots
+    if (handTotal.isEmpty()) {
+        printf("screenshot: mpv took none, skipped\n");
+        return QJsonObject {{"skipped", true}};
+    }
+
+    auto a = percentiles(copyConvert), b = percentiles(handConvert);
+    auto c = percentiles(copyTotal), d = percentiles(handTotal);
+    printf("screenshot 4k x%d: convert copy p50 %.2f ms, handover p50 %.3f ms; "
+            "total copy p50 %.2f ms, handover p50 %.2f ms\n", handTotal.size(),
+            a["p50_ms"].toDouble(), b["p50_ms"].toDouble(),
+            c["p50_ms"].toDouble(), d["p50_ms"].toDouble());
+    return QJsonObject {
+        {"copy", QJsonObject {{"convert", a}, {"total", c}}},
+        {"handover", QJsonObject {{"convert", b}, {"total", d}}},
+    };
+}
+
+static double threadCpuMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// gui thread cpu spent while a 120 fps clip plays: position notified for
+// every time-pos update with the time label rebuilt by QTime each time,
+// as it used to be, against the rate limited and preformatted way
+static QJsonObject benchPosition(dmr::PlayerEngine *engine, const QString& dir)
+{
+    auto path = dir + "/position.mkv";
+    if (!writeClip(path, 320, 180, 120 * 10, 120, 120)) return QJsonObject();
+
+    auto url = QUrl::fromLocalFile(path);
+    auto& model = engine->playlist();
+    model.append(url);
+    auto id = model.indexOf(url);
+    if (id < 0) return QJsonObject();
+
+    // don't go on to other items once stopped
+    auto mode = model.playMode();
+    model.setPlayMode(dmr::PlaylistModel::SinglePlay);
+
+    const int secs = 5;
+    QJsonObject ret;
+    for (int rate: {0, 4}) {
+        engine->setElapsedRate(rate);
+
+        QEventLoop loop;
+        QTimer timeout;
+        timeout.setSingleShot(true);
+        QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+        auto loaded = QObject::connect(engine, &dmr::PlayerEngine::fileLoaded, &loop, &QEventLoop::quit);
+        engine->playSelected(id);
+        timeout.start(5000);
+        loop.exec();
+        QObject::disconnect(loaded);
+        if (!timeout.isActive()) break;
+
+        int notified = 0;
+        qint64 shown = -1;
+        QString label, durationStr = "/" + dmr::utils::Time2str(engine->duration());
+        auto c = QObject::connect(engine, &dmr::PlayerEngine::elapsedChanged, [&]() {
+            notified++;
+            auto pos = engine->elapsed();
+            if (rate == 0) {
+                label = QString("%2/%1")
+                    .arg(QTime(0, 0, 0).addSecs(engine->duration()).toString("hh:mm:ss"))
+                    .arg(QTime(0, 0, 0).addSecs(pos).toString("hh:mm:ss"));
+            } else if (pos != shown) {
+                shown = pos;
+                label = dmr::utils::Time2str(pos) + durationStr;
+            }
+        });
+
+        auto cpu = threadCpuMs();
+        timeout.start(secs * 1000);
+        loop.exec();
+        cpu = threadCpuMs() - cpu;
+        QObject::disconnect(c);
+        engine->stop();
+
+        printf("position rate %d: %.1f notifications/s, gui thread cpu %.2f ms/s\n",
+                rate, notified / (double)secs, cpu / secs);
+        ret[rate ? "limited" : "every_update"] = QJsonObject {
+            {"rate", rate},
+            {"notifications_per_s", notified / (double)secs},
+            {"gui_cpu_ms_per_s", cpu / secs},
+        };
+    }
+
+    engine->setElapsedRate(4);
+    model.setPlayMode(mode);
+    if (ret.isEmpty()) {
+        printf("position: nothing got loaded, skipped\n");
+        return QJsonObject {{"skipped", true}};
+    }
+    return ret;
+}
+
+// from asking for the next file until it's loaded. the gui thread is
+// only busy for what it takes to ask, the rest is mpv tearing the last
+// one down and loading the next
+static QJsonObject benchSwitch(dmr::PlayerEngine *engine, int n)
+{
+    auto& model = engine->playlist();
+    if (model.count() < 2) return QJsonObject();
+
+    QEventLoop loop;
+    QTimer timeout;
+    timeout.setSingleShot(true);
+    QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+    auto c = QObject::connect(engine, &dmr::PlayerEngine::fileLoaded, &loop, &QEventLoop::quit);
+
+    QVector<qint64> blocked, latency;
+    engine->playSelected(0);
+    timeout.start(5000);
+    loop.exec();
+    for (int i = 0; i < n && timeout.isActive(); i++) {
+        QElapsedTimer t;
+        t.start();
+        engine->next();
+        blocked.append(t.nsecsElapsed());
+
+        timeout.start(5000);
+        loop.exec();
+        if (timeout.isActive()) latency.append(t.nsecsElapsed());
+    }
+    QObject::disconnect(c);
+    engine->stop();
+
+    // mpv could not play here, e.g no display
+    if (latency.isEmpty()) {
+        printf("switch: nothing got loaded, skipped\n");
+        return QJsonObject {{"skipped", true}};
+    }
+
+    auto a = percentiles(blocked), b = percentiles(latency);
+    printf("switch %d files: gui blocked p50 %.2f p99 %.2f ms, loaded after p50 %.2f p99 %.2f ms\n",
+            latency.size(), a["p50_ms"].toDouble(), a["p99_ms"].toDouble(),
+            b["p50_ms"].toDouble(), b["p99_ms"].toDouble());
+    return QJsonObject {
+        {"switches", latency.size()},
+        {"blocked", a},
+        {"latency", b},
+    };
+}
+
+// run an async append and wait for it to be done
+static qint64 appendAndWait(dmr::PlaylistModel& model, const QList<QUrl>& urls)
+{
+    QEventLoop loop;
+    auto c = QObject::connect(&model, &dmr::PlaylistModel::asyncAppendFinished,
+            &loop, &QEventLoop::quit);
+
+    QElapsedTimer t;
+    t.start();
+    model.appendAsync(urls);
+    loop.exec();
+    auto ns = t.nsecsElapsed();
+
+    QObject::disconnect(c);
+    return ns;
+}
+
+static QJsonObject benchAppend(dmr::PlaylistModel& model, int n)
+{
+    auto urls = makeUrls(n);
+    model.clear();
+
+    QElapsedTimer t;
+    t.start();
+    for (const auto& url: urls) {
+        model.append(url);
+    }
+    auto append_ns = t.nsecsElapsed();
+
+    t.restart();
+    for (const auto& url: urls) {
+        model.append(url); // all duplicates, should be rejected by lookup
+    }
+    auto dup_ns = t.nsecsElapsed();
+
+    Q_ASSERT(model.count() == n);
+    printf("append %6d: %8.2f ms (%6.3f us/item), duplicates %8.2f ms (%6.3f us/item)\n",
+            n, append_ns / 1e6, append_ns / 1e3 / n, dup_ns / 1e6, dup_ns / 1e3 / n);
+
+    return QJsonObject {
+        {"items", n},
+        {"append_ms", append_ns / 1e6},
+        {"append_us_per_item", append_ns / 1e3 / n},
+        {"duplicates_ms", dup_ns / 1e6},
+        {"duplicates_us_per_item", dup_ns / 1e3 / n},
+    };
+}
+
+// per file latency of quick vs full MovieInfo probing, median of a few runs
+// so that the page cache is warm for both
+static QJsonObject benchProbe(const QStringList& files)
+{
+    const int runs = 5;
+    auto measure = [=](const QFileInfo& fi, dmr::MovieInfo::ProbeMode mode, bool *ok) {
+        QVector<qint64> ns;
+        for (int i = 0; i < runs; i++) {
+            QElapsedTimer t;
+            t.start();
+            dmr::MovieInfo::parseFromFile(fi, ok, mode);
+            ns.append(t.nsecsElapsed());
+        }
+        std::sort(ns.begin(), ns.end());
+        return ns[runs / 2];
+    };
+
+    QMap<QString, QPair<qint64, qint64>> bySuffix;
+    QMap<QString, int> counts;
+    qint64 full_total = 0, quick_total = 0;
+    int n = 0, differ = 0;
+    for (const auto& f: files) {
+        QFileInfo fi(f);
+        bool full_ok = false, quick_ok = false;
+        auto full_ns = measure(fi, dmr::MovieInfo::FullProbe, &full_ok);
+        auto quick_ns = measure(fi, dmr::MovieInfo::QuickProbe, &quick_ok);
+        if (!full_ok && !quick_ok) continue;
+
+        if (full_ok != quick_ok) {
+            printf("probe %s: full and quick results differ\n", qPrintable(fi.fileName()));
+            differ++;
+        }
+        auto& s = bySuffix[fi.suffix()];
+        s.first += full_ns;
+        s.second += quick_ns;
+        counts[fi.suffix()]++;
+        full_total += full_ns;
+        quick_total += quick_ns;
+        n++;
+    }
+
+    QJsonObject res {{"files", n}, {"differ", differ}};
+    if (n == 0) return res;
+
+    printf("probe %d files: full %8.3f ms/file, quick %8.3f ms/file\n",
+            n, full_total / 1e6 / n, quick_total / 1e6 / n);
+    res["full_ms_per_file"] = full_total / 1e6 / n;
+    res["quick_ms_per_file"] = quick_total / 1e6 / n;
+
+    QJsonObject formats;
+    for (const auto& sfx: bySuffix.keys()) {
+        auto c = counts[sfx];
+        printf("probe   %-4s %4d files: full %8.3f ms/file, quick %8.3f ms/file\n",
+                qPrintable(sfx), c, bySuffix[sfx].first / 1e6 / c, bySuffix[sfx].second / 1e6 / c);
+        formats[sfx] = QJsonObject {
+            {"files", c},
+            {"full_ms_per_file", bySuffix[sfx].first / 1e6 / c},
+            {"quick_ms_per_file", bySuffix[sfx].second / 1e6 / c},
+        };
+    }
+    res["formats"] = formats;
+    return res;
+}
+
+// the cache pack is removed before the engine starts, so the first pass
+// probes every file and the second one is served by the cache
+static QJsonObject benchCache(dmr::PlaylistModel& model, const QStringList& files)
+{
+    QList<QUrl> urls;
+    for (const auto& f: files) urls.append(QUrl::fromLocalFile(f));
+
+    model.clear();
+    auto before = dmr::PlaylistModel::cacheStats();
+    auto cold_ns = appendAndWait(model, urls);
+    auto mid = dmr::PlaylistModel::cacheStats();
+
+    model.clear();
+    auto warm_ns = appendAndWait(model, urls);
+    auto after = dmr::PlaylistModel::cacheStats();
+
+    int n = qMax(1, urls.size());
+    printf("cache %d files: cold %8.2f ms (%6.3f ms/file), warm %8.2f ms (%6.3f ms/file), "
+            "warm hits %d misses %d stale %d\n", urls.size(),
+            cold_ns / 1e6, cold_ns / 1e6 / n, warm_ns / 1e6, warm_ns / 1e6 / n,
+            after.hits - mid.hits, after.misses - mid.misses, after.stale - mid.stale);
+
+    return QJsonObject {
+        {"files", urls.size()},
+        {"cold_ms", cold_ns / 1e6},
+        {"warm_ms", warm_ns / 1e6},
+        {"cold_misses", mid.misses - before.misses},
+        {"warm_hits", after.hits - mid.hits},
+        {"warm_misses", after.misses - mid.misses},
+        {"warm_stale", after.stale - mid.stale},
+        {"pack_bytes", (double)after.fileSize},
+    };
+}
+
+// restore a journal of n items, made of copies of the probed corpus
+static QJsonObject benchRestore(dmr::PlayerEngine *engine, const QString& journalPath,
+        const QList<dmr::PlayItemInfo>& probed, int n)
+{
+    QFile::remove(journalPath);
+    if (probed.isEmpty()) return QJsonObject();
+
+    {
+        dmr::PlaylistJournal journal(journalPath);
+        for (int i = 0; i < n; i++) {
+            auto pif = probed[i % probed.size()];
+            if (i >= probed.size()) {
+                // made up files, revalidation finds them unchanged (missing)
+                pif.url = QUrl::fromLocalFile(QString("%1.%2").arg(pif.info.filePath()).arg(i));
+                pif.info = QFileInfo(pif.url.toLocalFile());
+            }
+            journal.recordAppend(pif);
+        }
+    }
+
+    auto bytes = QFileInfo(journalPath).size();
+
+    QElapsedTimer t;
+    t.start();
+    auto *model = new dmr::PlaylistModel(engine);
+    auto ns = t.nsecsElapsed();
+    auto restored = model->count();
+    delete model;
+    QFile::remove(journalPath);
+
+    printf("restore %6d: %8.2f ms (%6.3f us/item)\n", restored, ns / 1e6, ns / 1e3 / qMax(1, restored));
+    return QJsonObject {
+        {"items", restored},
+        {"ms", ns / 1e6},
+        {"us_per_item", ns / 1e3 / qMax(1, restored)},
+        {"journal_bytes", (double)bytes},
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    // keep away from the real user playlist and cache
+    app.setOrganizationName("deepin");
+    app.setApplicationName("dmr-bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("libdmr playlist, probing and cache benchmark");
+    parser.addHelpOption();
+    parser.addOption({"corpus", "number of synthetic media files to generate", "n", "60"});
+    parser.addOption({"restore", "number of items in the restored playlist", "n", "10000"});
+    parser.addOption({"json", "where to write results", "file", "dmr-bench.json"});
+    parser.addPositionalArgument("media", "media files or directories to probe as well");
+    parser.process(app);
+
+    // required by mpv
+    setlocale(LC_NUMERIC, "C");
+
+    auto dir = QString("%1/%2/%3")
+        .arg(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation))
+        .arg(app.organizationName())
+        .arg(app.applicationName());
+    auto journalPath = dir + "/playlist.journal";
+    // start cold, before anything maps the pack
+    QFile::remove(dir + "/cache.pack");
+    QFile::remove(journalPath);
+
+    auto engine = new dmr::PlayerEngine;
+    auto& model = engine->playlist();
+
+    QTemporaryDir corpusDir;
+    QElapsedTimer t;
+    t.start();
+    auto corpus = makeCorpus(corpusDir.path(), parser.value("corpus").toInt());
+    printf("corpus %d files generated in %.2f ms\n", corpus.size(), t.nsecsElapsed() / 1e6);
+
+    QJsonObject results {
+        {"timestamp", QDateTime::currentDateTime().toString(Qt::ISODate)},
+        {"qt", qVersion()},
+        {"libavformat", LIBAVFORMAT_IDENT},
+        {"corpus_files", corpus.size()},
+    };
+
+    // per item cost should stay flat while the list grows
+    QJsonArray appends;
+    for (int n = 10000; n <= 50000; n += 10000) {
+        appends.append(benchAppend(model, n));
+    }
+    results["append"] = appends;
+
+    results["probe"] = benchProbe(corpus);
+    auto extra = parser.positionalArguments();
+    if (!extra.isEmpty()) {
+        QStringList files;
+        for (const auto& a: extra) {
+            QFileInfo fi(a);
+            if (fi.isDir()) {
+                QDirIterator it(a, QDir::Files, QDirIterator::Subdirectories);
+                while (it.hasNext()) files.append(it.next());
+            } else if (fi.isFile()) {
+                files.append(a);
+            }
+        }
+        results["probe_media"] = benchProbe(files);
+    }
+
+    results["cache"] = benchCache(model, corpus);
+    results["preview"] = benchPreview(corpusDir.path());
+    results["thumbnail"] = benchThumbnail(corpus);
+    results["switch"] = benchSwitch(engine, 20);
+    results["screenshot"] = benchScreenshot(corpusDir.path());
+    results["position"] = benchPosition(engine, corpusDir.path());
+
+    QList<dmr::PlayItemInfo> probed;
+    for (int i = 0; i < model.count(); i++) probed.append(model.items()[i]);
+    model.clear();
+    results["restore"] = benchRestore(engine, journalPath, probed, parser.value("restore").toInt());
+
+    QFile f(parser.value("json"));
+    if (f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        f.write(QJsonDocument(results).toJson());
+        printf("results written to %s\n", qPrintable(f.fileName()));
+    } else {
+        qWarning() << "can not write results" << f.errorString();
+    }
+
+    delete engine;
+    return 0;
+}
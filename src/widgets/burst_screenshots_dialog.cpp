@@ -31,6 +31,7 @@
 #include "burst_screenshots_dialog.h"
 #include "dmr_settings.h"
 #include "utils.h"
+#include "frame_decoder.h"
 
 #include <dthememanager.h>
 
@@ -38,7 +39,7 @@ DWIDGET_USE_NAMESPACE
 
 namespace dmr {
 BurstScreenshotsDialog::BurstScreenshotsDialog(const PlayItemInfo& pif)
-    :DDialog(nullptr)
+    :DDialog(nullptr), _url(pif.url)
 {
     auto mi = pif.mi;
 
@@ -163,6 +164,12 @@ BurstScreenshotsDialog::BurstScreenshotsDialog(const PlayItemInfo& pif)
     addContent(mainContent, Qt::AlignCenter);
 }
 
+QSize BurstScreenshotsDialog::frameSize()
+{
+    auto dpr = qApp->devicePixelRatio();
+    return QSize(178 * dpr - 2, 100 * dpr - 2);
+}
+
 void BurstScreenshotsDialog::updateWithFrames(const QList<QPair<QImage, qint64>>& frames)
 {
     auto dpr = qApp->devicePixelRatio();
@@ -170,7 +177,8 @@ void BurstScreenshotsDialog::updateWithFrames(const QList<QPair<QImage, qint64>>
     
     int count = 0;
     for (auto frame: frames) {
-        auto scaled = frame.first.scaled(sz.width()-2, sz.height()-2,
+        // no-op if it's been taken in frameSize()
+        auto scaled = frame.first.scaled(frameSize(),
                 Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
         auto *l = new ThumbnailFrame(this);
 
@@ -203,11 +211,26 @@ void BurstScreenshotsDialog::savePoster()
 
 void BurstScreenshotsDialog::saveShootings()
 {
-    int i = 1;
-    for (auto& img: _thumbs) {
-        auto file_path = Settings::get().screenshotNameSeqTemplate().arg(i++);
-        img.first.save(file_path);
+    QStringList paths;
+    for (int i = 1; i <= _thumbs.size(); i++) {
+        paths.append(Settings::get().screenshotNameSeqTemplate().arg(i));
     }
+
+    // frames of a local file were taken just as big as they are shown, the
+    // full sized ones are decoded off the gui thread, at the pts of each
+    auto thumbs = _thumbs;
+    auto url = _url;
+    QtConcurrent::run([=]() {
+        FrameDecoder d;
+        bool full = url.isLocalFile() && d.open(url.toLocalFile());
+        for (int i = 0; i < thumbs.size(); i++) {
+            const auto& img = thumbs[i].first;
+            QImage frame;
+            auto pts = img.text("pts");
+            if (full && !pts.isEmpty()) frame = d.frameAt(pts.toLongLong(), QSize());
+            (frame.isNull() ? img : frame).save(paths[i]);
+        }
+    });
     DDialog::accept();
 }
 
@@ -58,6 +58,8 @@ class BurstScreenshotsDialog: public DDialog {
     Q_OBJECT
 public:
     BurstScreenshotsDialog(const PlayItemInfo& pif);
+    // size frames are shown at, in device pixels
+    static QSize frameSize();
     void updateWithFrames(const QList<QPair<QImage, qint64>>& frames);
 
     QString savedPosterPath();
@@ -71,6 +73,7 @@ private:
     QGridLayout *_grid {nullptr};
     QPushButton *_saveBtn {nullptr};
     QList<QPair<QImage, qint64>> _thumbs;
+    QUrl _url;
     QString _posterPath;
 };
 }
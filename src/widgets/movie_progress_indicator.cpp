@@ -74,8 +74,18 @@ void MovieProgressIndicator::paintEvent(QPaintEvent* pe)
 void MovieProgressIndicator::updateMovieProgress(qint64 duration, qint64 pos)
 {
     _elapsed = pos;
-    _pert = (qreal)pos / duration;
-    update();
+    auto pert = duration > 0 ? (qreal)pos / duration : 0.0;
+
+    // repaint only when a dot or the clock would change
+    int dots = qMin(pert * 10, 10.0);
+    int shown = qMin(_pert * 10, 10.0);
+    int minute = QTime::currentTime().minute();
+    bool changed = dots != shown || minute != _shownMinute;
+    _pert = pert;
+    if (changed) {
+        _shownMinute = minute;
+        update();
+    }
 }
 
 }
@@ -47,6 +47,7 @@ protected:
 private:
     qint64 _elapsed {0};
     qreal _pert {0.0};
+    int _shownMinute {-1};
     QSize _fixedSize;
 };
 
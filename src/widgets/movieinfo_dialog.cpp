@@ -38,7 +38,7 @@
 DWIDGET_USE_NAMESPACE
 
 namespace dmr {
-MovieInfoDialog::MovieInfoDialog(const struct PlayItemInfo& pif)
+MovieInfoDialog::MovieInfoDialog(const struct PlayItemInfo& pif, const QPixmap& thumb)
     :DAbstractDialog(nullptr)
 {
     setFixedWidth(320);
@@ -63,18 +63,14 @@ MovieInfoDialog::MovieInfoDialog(const struct PlayItemInfo& pif)
     layout->addLayout(ml);
 
     auto *pm = new PosterFrame(this);
-    pm->setFixedSize(176, 118);
+    pm->setFixedSize(PlaylistModel::thumbnailSize(PlaylistModel::PosterThumb));
 
-    auto dpr = qApp->devicePixelRatio();
     QPixmap cover;
-    if (pif.thumbnail.isNull()) {
+    if (thumb.isNull()) {
         cover = (utils::LoadHiDPIPixmap(":/resources/icons/logo-big.svg"));
     } else {
-        QSize sz(176, 118);
-        sz *= dpr;
-        auto img = pif.thumbnail.scaledToWidth(sz.width(), Qt::SmoothTransformation);
-        cover = img.copy(0, (img.height()-sz.height())/2, sz.width(), sz.height());
-        cover.setDevicePixelRatio(dpr);
+        // made in poster size already, see PlaylistModel::PosterThumb
+        cover = thumb;
     }
     cover = utils::MakeRoundedPixmap(cover, 4, 4);
     pm->setPixmap(cover);
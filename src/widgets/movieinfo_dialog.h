@@ -52,7 +52,7 @@ public:
 class MovieInfoDialog: public DAbstractDialog {
     Q_OBJECT
 public:
-    MovieInfoDialog(const struct PlayItemInfo&);
+    MovieInfoDialog(const struct PlayItemInfo&, const QPixmap& thumb);
 };
 }
 
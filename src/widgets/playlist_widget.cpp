@@ -133,8 +133,8 @@ class PlayItemWidget: public QFrame {
 public:
     friend class PlaylistWidget;
 
-    PlayItemWidget(const PlayItemInfo& pif, QListWidget* list = 0)
-        : QFrame(), _pif {pif}, _listWidget {list} 
+    PlayItemWidget(const PlayItemInfo& pif, PlaylistModel* model, QListWidget* list = 0)
+        : QFrame(), _pif {pif}, _model {model}, _listWidget {list} 
     {
         DThemeManager::instance()->registerWidget(this, QStringList() << "PlayItemThumb");
         
@@ -256,22 +256,18 @@ public:
         }
 
         // thumb size
-        QSize sz(22, 40);
+        auto sz = PlaylistModel::thumbnailSize(PlaylistModel::PlaylistThumb);
         sz *= dpr;
 
         p.drawPixmap(0, 0, pm);
 
-        if (!_pif.thumbnail.isNull()) {
-            auto img = _pif.thumbnail.scaledToHeight(sz.height(), Qt::SmoothTransformation);
-            img.setDevicePixelRatio(dpr);
-
+        // only resident while the row is visible, do not hold on to it.
+        // it's made in the exact size, so no scaling here
+        auto thumb = _model->thumbnail(_pif.url);
+        if (!thumb.isNull()) {
             QPointF target_pos((pm.width() - sz.width())/2, (pm.height() - sz.height())/2);
             target_pos /= dpr;
-
-            QRectF src_rect((img.width()-sz.width())/2, (img.height()-sz.height())/2,
-                    sz.width(), sz.height());
-            p.drawPixmap(target_pos, img, src_rect);
-
+            p.drawPixmap(target_pos, thumb);
         }
 
         if (state() == ItemState::Playing) {
@@ -414,6 +410,7 @@ private:
     QLabel *_time;
     QPixmap _play;
     PlayItemInfo _pif;
+    PlaylistModel *_model {nullptr};
     DImageButton *_closeBtn;
     QListWidget *_listWidget {nullptr};
     bool _hovered {false};
@@ -515,6 +512,7 @@ PlaylistWidget::PlaylistWidget(QWidget *mw, PlayerEngine *mpv)
     connect(&_engine->playlist(), &PlaylistModel::itemRemoved, this, &PlaylistWidget::removeItem);
     connect(&_engine->playlist(), &PlaylistModel::currentChanged, this, &PlaylistWidget::updateItemStates);
     connect(&_engine->playlist(), &PlaylistModel::itemInfoUpdated, this, &PlaylistWidget::updateItemInfo);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &PlaylistWidget::reportVisibleRows);
 
     QTimer::singleShot(10, this, &PlaylistWidget::loadPlaylist);
 
@@ -591,7 +589,7 @@ void PlaylistWidget::showItemInfo()
     if (!_mouseItem) return;
     auto item = dynamic_cast<PlayItemWidget*>(_mouseItem);
     if (item) {
-        MovieInfoDialog mid(item->_pif);
+        MovieInfoDialog mid(item->_pif, _engine->playlist().loadThumbnail(item->_pif.url));
         mid.exec();
     }
 }
@@ -714,6 +712,19 @@ void PlaylistWidget::showEvent(QShowEvent *se)
 {
     batchUpdateSizeHints();
     adjustSize();
+    reportVisibleRows();
+}
+
+void PlaylistWidget::reportVisibleRows()
+{
+    if (!isVisible() || !count()) return;
+
+    auto r = viewport()->rect();
+    auto first = indexAt(r.topLeft()).row();
+    auto last = indexAt(r.bottomLeft()).row();
+    if (first < 0) first = 0;
+    if (last < 0) last = count() - 1;
+    _engine->playlist().setVisibleRows(first, last);
 }
 
 void PlaylistWidget::removeItem(int idx)
@@ -725,14 +736,17 @@ void PlaylistWidget::removeItem(int idx)
     }
 }
 
-void PlaylistWidget::appendItems()
+void PlaylistWidget::appendItems(int from, int count)
 {
-    qDebug() << __func__;
+    qDebug() << __func__ << from << count;
 
-    auto items = _engine->playlist().items();
+    // rows before this->count() are already there if the widget got rebuilt
+    // by loadPlaylist in the meantime
+    const auto& items = _engine->playlist().items();
     auto p = items.begin() + this->count();
-    while (p != items.end()) {
-        auto w = new PlayItemWidget(*p, this);
+    auto end = items.begin() + qMin(from + count, items.size());
+    while (p < end) {
+        auto w = new PlayItemWidget(*p, &_engine->playlist(), this);
         auto item = new QListWidgetItem;
         addItem(item);
         setItemWidget(item, w);
@@ -747,6 +761,7 @@ void PlaylistWidget::appendItems()
     batchUpdateSizeHints();
     updateItemStates();
     setStyleSheet(styleSheet());
+    reportVisibleRows();
 }
 
 void PlaylistWidget::loadPlaylist()
@@ -758,7 +773,7 @@ void PlaylistWidget::loadPlaylist()
     auto items = _engine->playlist().items();
     auto p = items.begin();
     while (p != items.end()) {
-        auto w = new PlayItemWidget(*p, this);
+        auto w = new PlayItemWidget(*p, &_engine->playlist(), this);
         auto item = new QListWidgetItem;
         addItem(item);
         setItemWidget(item, w);
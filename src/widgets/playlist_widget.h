@@ -78,8 +78,9 @@ protected:
 protected slots:
     void updateItemStates();
     void updateItemInfo(int);
-    void appendItems();
+    void appendItems(int from, int count);
     void removeItem(int);
+    void reportVisibleRows();
 
 private:
 
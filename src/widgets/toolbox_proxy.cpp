@@ -715,6 +715,20 @@ void ToolboxProxy::setup()
         updateTimeInfo(_engine->duration(), _engine->elapsed());
         updateMovieProgress();
     });
+    auto updateDurationStr = [=]() {
+        //mpv returns a slightly different duration from movieinfo.duration
+        const auto& pl = _engine->playlist();
+        // loads finish asynchronously, the playlist may be empty by now
+        if (pl.count() == 0 || pl.current() < 0) return;
+        _durationStr = "/" + pl.currentInfo().mi.durationStr();
+        _shownSecs = -1;
+        updateTimeInfo(_engine->duration(), _engine->elapsed());
+    };
+    connect(_engine, &PlayerEngine::fileLoaded, updateDurationStr);
+    // duration of network items is known once they play
+    connect(&_engine->playlist(), &PlaylistModel::itemInfoUpdated, [=](int id) {
+        if (id == _engine->playlist().current()) updateDurationStr();
+    });
     connect(window()->windowHandle(), &QWindow::windowStateChanged, this, &ToolboxProxy::updateFullState);
     connect(_engine, &PlayerEngine::muteChanged, this, &ToolboxProxy::updateVolumeState);
     connect(_engine, &PlayerEngine::volumeChanged, this, &ToolboxProxy::updateVolumeState);
@@ -730,6 +744,24 @@ void ToolboxProxy::setup()
 
     connect(&ThumbnailWorker::get(), &ThumbnailWorker::thumbGenerated,
             this, &ToolboxProxy::updateHoverPreview);
+    // previews of the previous file won't be asked for anymore
+    connect(_engine, &PlayerEngine::fileLoaded, [=](const QUrl& url) {
+        ThumbnailWorker::get().setPlayingUrl(url);
+        if (url.isLocalFile() && Settings::get().isSet(Settings::PreviewOnMouseover))
+            ThumbnailWorker::get().loadStoryboard(url, _engine->duration());
+    });
+
+    // decoding ahead competes with playback, back off for a while once it
+    // starts dropping frames
+    _prefetchResumeTimer.setSingleShot(true);
+    _prefetchResumeTimer.setInterval(5000);
+    connect(&_prefetchResumeTimer, &QTimer::timeout, [=]() {
+        ThumbnailWorker::get().setPrefetchPaused(false);
+    });
+    connect(_engine, &PlayerEngine::framesDropped, [=]() {
+        ThumbnailWorker::get().setPrefetchPaused(true);
+        _prefetchResumeTimer.start();
+    });
 
     auto bubbler = new KeyPressBubbler(this);
     this->installEventFilter(bubbler);
@@ -772,7 +804,15 @@ void ToolboxProxy::updateHoverPreview(const QUrl& url, int secs)
     if (_engine->playlist().currentInfo().url != url)
         return;
 
-    QPixmap pm = ThumbnailWorker::get().getThumb(url, secs);
+    // prefetched ones arrive here too, only the one under the cursor counts
+    if (secs != _hoverThumbSecs)
+        return;
+
+    // may come from the storyboard, when the exact one failed
+    int at = secs;
+    QPixmap pm = ThumbnailWorker::get().nearestThumb(url, &at);
+    if (pm.isNull())
+        return;
 
     _previewer->updateWithPreview(pm, secs, _engine->videoRotation());
 }
@@ -799,7 +839,14 @@ void ToolboxProxy::progressHoverChanged(int v)
     }
 
     _lastHoverValue = v;
-    ThumbnailWorker::get().requestThumb(pif.url, v);
+    _hoverThumbSecs = ThumbnailWorker::get().previewPosition(pif.url, v);
+    ThumbnailWorker::get().requestThumb(pif.url, _hoverThumbSecs);
+
+    // a prefetched preview at or near v stands in until the exact one is ready
+    int at = _hoverThumbSecs;
+    auto pm = ThumbnailWorker::get().nearestThumb(pif.url, &at);
+    if (!pm.isNull())
+        _previewer->updateWithPreview(pm, v, _engine->videoRotation());
 
     auto pos = _progBar->mapToGlobal(QPoint(0, TOOLBOX_TOP_EXTENT - 10));
     QPoint p { QCursor::pos().x(), pos.y() };
@@ -812,7 +859,14 @@ void ToolboxProxy::setProgress()
     if (_engine->state() == PlayerEngine::CoreState::Idle)
         return;
 
-    _engine->seekAbsolute(_progBar->sliderPosition());
+    // while dragging, landing on a keyframe keeps up with the cursor. the
+    // second after it is taken, so mpv decodes from that one
+    auto pos = _progBar->sliderPosition();
+    if (_progBar->isSliderDown()) {
+        auto kf = _engine->nearestKeyframe(pos * 1000LL);
+        if (kf >= 0 && qAbs(kf - pos * 1000LL) < 5000) pos = (kf + 999) / 1000;
+    }
+    _engine->seekAbsolute(pos);
     if (_progBar->sliderPosition() != _lastHoverValue) {
         progressHoverChanged(_progBar->sliderPosition());
     }
@@ -913,14 +967,14 @@ void ToolboxProxy::updateTimeInfo(qint64 duration, qint64 pos)
 {
     if (_engine->state() == PlayerEngine::CoreState::Idle) {
         _timeLabel->setText("");
+        _shownSecs = -1;
 
-    } else {
+    } else if (pos != _shownSecs) {
         //mpv returns a slightly different duration from movieinfo.duration
         //_timeLabel->setText(QString("%2/%1").arg(utils::Time2str(duration))
                 //.arg(utils::Time2str(pos)));
-        _timeLabel->setText(QString("%2/%1")
-                .arg(_engine->playlist().currentInfo().mi.durationStr())
-                .arg(utils::Time2str(pos)));
+        _shownSecs = pos;
+        _timeLabel->setText(utils::Time2str(pos) + _durationStr);
     }
 }
 
@@ -110,7 +110,12 @@ private:
     ThumbnailPreview *_previewer {nullptr};
     SubtitlesView *_subView {nullptr};
     int _lastHoverValue {0};
+    int _hoverThumbSecs {0}; // preview requested for _lastHoverValue
     QTimer _previewTimer;
+    QTimer _prefetchResumeTimer;
+    // time label is only rebuilt when its second changes
+    QString _durationStr; // "/hh:mm:ss" of current file
+    qint64 _shownSecs {-1};
 };
 }
 